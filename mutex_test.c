@@ -1,141 +1,1941 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 // Return status codes
 #define RHINO_SUCCESS           0
 #define RHINO_NULL_PTR         1
 #define RHINO_MUTEX_OWNER_ERR  2
 #define RHINO_MUTEX_NOT_OWNER  3
+#define RHINO_TIMEOUT          4
+#define RHINO_NO_PEND_WAIT     5   // Busy and the caller asked not to wait
+#define RHINO_NO_MEM           6
+
+// Timeouts, in ms
+#define RHINO_NO_WAIT           0
+#define RHINO_WAIT_FOREVER     -1
+
+// Futex word states
+#define KMUTEX_UNLOCKED         0
+#define KMUTEX_LOCKED           1
+#define KMUTEX_CONTENDED        2   // Locked, and someone may be parked in the kernel
+
+// Mutex types
+#define KMUTEX_TYPE_NORMAL      0
+#define KMUTEX_TYPE_PI          1   // Priority inheritance, the word holds the owner's tid
+#define KMUTEX_TYPE_FAIR        2   // FIFO handoff to queued waiters
+
+// Upper bound on spin iterations before parking
+#define KMUTEX_SPIN_MAX         100
+
+#ifndef FUTEX_LOCK_PI2
+#define FUTEX_LOCK_PI2          13  // FUTEX_LOCK_PI with a CLOCK_MONOTONIC deadline, Linux 5.14+
+#endif
+
+// Fair-mode waiter, on the waiting thread's stack
+typedef struct kmutex_waiter {
+    struct kmutex_waiter *next;
+    int granted;        // Futex word, set once the lock is handed over
+} kmutex_waiter_t;
 
 // Mutex structure
 typedef struct {
-    pthread_mutex_t mutex;
-    pthread_t owner;
-    const char *name;
-    int lock_count;  // For recursive mutex support
-} kmutex_t;
+    int state;          // Futex word, one of KMUTEX_*
+    pid_t owner;        // Kernel thread id of the holder, 0 when free
+    const char *name;
+    int lock_count;     // For recursive mutex support, only touched by the owner
+    int spin;           // Running average of spins needed to get the lock
+    int type;           // KMUTEX_TYPE_*
+    int boosts;         // PI: blocking acquires handed over by a lower-priority owner
+    int qlock;          // Fair: protects the waiter queue
+    kmutex_waiter_t *head;  // Fair: waiters in arrival order
+    kmutex_waiter_t *tail;
+#ifdef KMUTEX_PROFILE
+    int prof_id;        // Slot in the per-thread stats, -1 if not tracked
+    uint64_t prof_since;    // When the owner acquired it, only touched by the owner
+#endif
+} kmutex_t;
+
+// Spinning only pays off when the holder can run at the same time
+static int kmutex_spin_max = -1;
+
+static __thread pid_t kmutex_tid;
+
+static inline pid_t kmutex_self(void) {
+    if (kmutex_tid == 0) {
+        kmutex_tid = (pid_t)syscall(SYS_gettid);
+    }
+    return kmutex_tid;
+}
+
+static inline void kmutex_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline void kmutex_futex_wait(int *addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void kmutex_futex_wake(int *addr, int nr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+// Wait with an absolute CLOCK_MONOTONIC deadline, NULL waits forever.
+// Returns ETIMEDOUT once the deadline has passed, 0 otherwise.
+static inline int kmutex_futex_wait_until(int *addr, int val, const struct timespec *deadline) {
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL,
+                FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT) {
+        return ETIMEDOUT;
+    }
+    return 0;
+}
+
+static void kmutex_deadline(struct timespec *ts, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Contention profiling, built only with -DKMUTEX_PROFILE. Stats are
+// keyed by mutex name: every mutex created with the same name shares one
+// slot. Each thread counts into its own block, so profiling adds no
+// shared cache-line writes. A block only holds stats for the names its
+// thread has used; when the thread exits they are folded into
+// kmutex_prof_exited and the block is freed, so thread churn does not
+// grow memory. Histograms use log2(ns) buckets.
+#ifdef KMUTEX_PROFILE
+#define KMUTEX_PROF_MAX         64  // Distinct names tracked
+#define KMUTEX_PROF_BUCKETS     40  // Bucket b counts [2^b, 2^(b+1)) ns, the last one open-ended
+
+typedef struct {
+    uint64_t acquires;
+    uint64_t contended;
+    uint64_t wait_max;
+    uint64_t hold_max;
+    uint64_t wait_hist[KMUTEX_PROF_BUCKETS];
+    uint64_t hold_hist[KMUTEX_PROF_BUCKETS];
+} kmutex_prof_stat_t;
+
+typedef struct kmutex_prof_thread {
+    struct kmutex_prof_thread *next;
+    pid_t tid;
+    kmutex_prof_stat_t *stat[KMUTEX_PROF_MAX];  // Allocated on first use of each name
+} kmutex_prof_thread_t;
+
+// Everything below is protected by kmutex_prof_lock, except that each
+// thread fills in its own block
+static pthread_mutex_t kmutex_prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *kmutex_prof_names[KMUTEX_PROF_MAX];
+static int kmutex_prof_count;
+static kmutex_prof_thread_t *kmutex_prof_threads;
+static kmutex_prof_stat_t kmutex_prof_exited[KMUTEX_PROF_MAX];  // Folded in from exited threads
+static pid_t kmutex_prof_exited_holder[KMUTEX_PROF_MAX];
+static pthread_once_t kmutex_prof_once = PTHREAD_ONCE_INIT;
+static pthread_key_t kmutex_prof_key;
+static __thread kmutex_prof_thread_t *kmutex_prof_self;
+
+static inline uint64_t kmutex_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline int kmutex_prof_bucket(uint64_t ns) {
+    int b = 63 - __builtin_clzll(ns | 1);
+
+    return b < KMUTEX_PROF_BUCKETS ? b : KMUTEX_PROF_BUCKETS - 1;
+}
+
+// Counters have a single writer; the dump reads them concurrently
+static inline void kmutex_prof_add(uint64_t *counter, uint64_t val) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+static inline void kmutex_prof_max(uint64_t *counter, uint64_t val) {
+    if (val > __atomic_load_n(counter, __ATOMIC_RELAXED)) {
+        __atomic_store_n(counter, val, __ATOMIC_RELAXED);
+    }
+}
+
+static int kmutex_prof_register(const char *name) {
+    int id;
+
+    pthread_mutex_lock(&kmutex_prof_lock);
+    for (id = 0; id < kmutex_prof_count; id++) {
+        if (strcmp(kmutex_prof_names[id], name) == 0) {
+            break;
+        }
+    }
+    if (id == kmutex_prof_count) {
+        if (id < KMUTEX_PROF_MAX) {
+            kmutex_prof_names[kmutex_prof_count++] = name;
+        } else {
+            id = -1;
+        }
+    }
+    pthread_mutex_unlock(&kmutex_prof_lock);
+
+    return id;
+}
+
+// Add src, read while its thread may still be counting, into dst.
+// *holder becomes tid if src has the longest hold so far.
+static void kmutex_prof_fold(kmutex_prof_stat_t *dst, pid_t *holder, kmutex_prof_stat_t *src, pid_t tid) {
+    uint64_t max;
+
+    dst->acquires += __atomic_load_n(&src->acquires, __ATOMIC_RELAXED);
+    dst->contended += __atomic_load_n(&src->contended, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&src->wait_max, __ATOMIC_RELAXED);
+    if (max > dst->wait_max) {
+        dst->wait_max = max;
+    }
+    max = __atomic_load_n(&src->hold_max, __ATOMIC_RELAXED);
+    if (max > dst->hold_max) {
+        dst->hold_max = max;
+        *holder = tid;
+    }
+    for (int b = 0; b < KMUTEX_PROF_BUCKETS; b++) {
+        dst->wait_hist[b] += __atomic_load_n(&src->wait_hist[b], __ATOMIC_RELAXED);
+        dst->hold_hist[b] += __atomic_load_n(&src->hold_hist[b], __ATOMIC_RELAXED);
+    }
+}
+
+// Thread exit: fold the block into kmutex_prof_exited and free it
+static void kmutex_prof_thread_exit(void *arg) {
+    kmutex_prof_thread_t *self = arg;
+    kmutex_prof_thread_t **pp;
+
+    pthread_mutex_lock(&kmutex_prof_lock);
+    for (pp = &kmutex_prof_threads; *pp != self; pp = &(*pp)->next) {
+    }
+    *pp = self->next;
+    for (int id = 0; id < KMUTEX_PROF_MAX; id++) {
+        if (self->stat[id]) {
+            kmutex_prof_fold(&kmutex_prof_exited[id], &kmutex_prof_exited_holder[id], self->stat[id], self->tid);
+            free(self->stat[id]);
+        }
+    }
+    pthread_mutex_unlock(&kmutex_prof_lock);
+
+    free(self);
+    kmutex_prof_self = NULL;
+}
+
+static void kmutex_prof_key_init(void) {
+    pthread_key_create(&kmutex_prof_key, kmutex_prof_thread_exit);
+}
+
+static kmutex_prof_stat_t *kmutex_prof_stat(kmutex_t *mutex) {
+    kmutex_prof_thread_t *self = kmutex_prof_self;
+    kmutex_prof_stat_t *stat;
+
+    if (mutex->prof_id < 0) {
+        return NULL;
+    }
+    if (self == NULL) {
+        self = calloc(1, sizeof(*self));
+        if (self == NULL) {
+            return NULL;
+        }
+        self->tid = kmutex_self();
+        pthread_once(&kmutex_prof_once, kmutex_prof_key_init);
+        pthread_setspecific(kmutex_prof_key, self);
+        pthread_mutex_lock(&kmutex_prof_lock);
+        self->next = kmutex_prof_threads;
+        kmutex_prof_threads = self;
+        pthread_mutex_unlock(&kmutex_prof_lock);
+        kmutex_prof_self = self;
+    }
+
+    stat = self->stat[mutex->prof_id];
+    if (stat == NULL) {
+        stat = calloc(1, sizeof(*stat));
+        if (stat == NULL) {
+            return NULL;
+        }
+        // The dump may be looking at this block
+        __atomic_store_n(&self->stat[mutex->prof_id], stat, __ATOMIC_RELEASE);
+    }
+
+    return stat;
+}
+
+// wait_start is 0 when the fast path got the lock
+static void kmutex_prof_acquired(kmutex_t *mutex, uint64_t wait_start) {
+    kmutex_prof_stat_t *stat = kmutex_prof_stat(mutex);
+    uint64_t now = kmutex_now_ns();
+    uint64_t wait = wait_start ? now - wait_start : 0;
+
+    mutex->prof_since = now;
+    if (stat == NULL) {
+        return;
+    }
+    kmutex_prof_add(&stat->acquires, 1);
+    if (wait_start) {
+        kmutex_prof_add(&stat->contended, 1);
+    }
+    kmutex_prof_add(&stat->wait_hist[kmutex_prof_bucket(wait)], 1);
+    kmutex_prof_max(&stat->wait_max, wait);
+}
+
+static void kmutex_prof_release(kmutex_t *mutex) {
+    kmutex_prof_stat_t *stat = kmutex_prof_stat(mutex);
+    uint64_t hold = kmutex_now_ns() - mutex->prof_since;
+
+    if (stat == NULL) {
+        return;
+    }
+    kmutex_prof_add(&stat->hold_hist[kmutex_prof_bucket(hold)], 1);
+    kmutex_prof_max(&stat->hold_max, hold);
+}
+
+// Sum one name's stats over all threads, live and exited; *holder gets
+// the thread with the longest single hold. Caller holds kmutex_prof_lock.
+static void kmutex_prof_sum(int id, kmutex_prof_stat_t *sum, pid_t *holder) {
+    kmutex_prof_thread_t *t;
+    kmutex_prof_stat_t *stat;
+
+    *sum = kmutex_prof_exited[id];
+    *holder = kmutex_prof_exited_holder[id];
+    for (t = kmutex_prof_threads; t != NULL; t = t->next) {
+        stat = __atomic_load_n(&t->stat[id], __ATOMIC_ACQUIRE);
+        if (stat) {
+            kmutex_prof_fold(sum, holder, stat, t->tid);
+        }
+    }
+}
+
+static void kmutex_prof_print_hist(const char *label, const uint64_t *hist) {
+    static const char *units[] = { "ns", "us", "ms", "s" };
+
+    printf("  %s:", label);
+    for (int b = 0; b < KMUTEX_PROF_BUCKETS; b++) {
+        uint64_t low = b ? 1ull << b : 0;
+        int u = 0;
+
+        if (hist[b] == 0) {
+            continue;
+        }
+        while (low >= 1000 && u < 3) {
+            low /= 1000;
+            u++;
+        }
+        printf(" %llu%s:%llu", (unsigned long long)low, units[u], (unsigned long long)hist[b]);
+    }
+    printf("\n");
+}
+
+// Print every tracked name: counts, worst wait and hold, the thread with
+// the longest hold, and both histograms (bucket lower bound:count)
+void krhino_mutex_prof_dump(void) {
+    kmutex_prof_stat_t sum;
+    pid_t holder;
+
+    pthread_mutex_lock(&kmutex_prof_lock);
+    printf("%-20s %10s %10s %12s %12s %8s\n", "mutex", "acquires", "contended",
+           "max wait ns", "max hold ns", "holder");
+    for (int id = 0; id < kmutex_prof_count; id++) {
+        kmutex_prof_sum(id, &sum, &holder);
+        printf("%-20s %10llu %10llu %12llu %12llu %8d\n", kmutex_prof_names[id],
+               (unsigned long long)sum.acquires, (unsigned long long)sum.contended,
+               (unsigned long long)sum.wait_max, (unsigned long long)sum.hold_max, (int)holder);
+        kmutex_prof_print_hist("wait", sum.wait_hist);
+        kmutex_prof_print_hist("hold", sum.hold_hist);
+    }
+    pthread_mutex_unlock(&kmutex_prof_lock);
+}
+
+#define KMUTEX_PROF_DECL(wait)              uint64_t wait = 0
+#define KMUTEX_PROF_WAIT(wait)              (wait = kmutex_now_ns())
+#define KMUTEX_PROF_ACQUIRED(mutex, wait)   kmutex_prof_acquired(mutex, wait)
+#define KMUTEX_PROF_RELEASE(mutex)          kmutex_prof_release(mutex)
+#else
+#define KMUTEX_PROF_DECL(wait)
+#define KMUTEX_PROF_WAIT(wait)              ((void)0)
+#define KMUTEX_PROF_ACQUIRED(mutex, wait)   ((void)0)
+#define KMUTEX_PROF_RELEASE(mutex)          ((void)0)
+#endif
+
+static int kmutex_init(kmutex_t *mutex, const char *name, int type) {
+    if (mutex == NULL || name == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    if (kmutex_spin_max < 0) {
+        kmutex_spin_max = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? KMUTEX_SPIN_MAX : 0;
+    }
+
+    mutex->state = KMUTEX_UNLOCKED;
+    mutex->name = name;
+    mutex->owner = 0;
+    mutex->lock_count = 0;
+    mutex->spin = 0;
+    mutex->type = type;
+    mutex->boosts = 0;
+    mutex->qlock = 0;
+    mutex->head = NULL;
+    mutex->tail = NULL;
+#ifdef KMUTEX_PROFILE
+    mutex->prof_id = kmutex_prof_register(name);
+#endif
+
+    printf("Mutex '%s' created%s\n", name,
+           type == KMUTEX_TYPE_PI ? " (priority inheritance)" : type == KMUTEX_TYPE_FAIR ? " (fair)" : "");
+    return RHINO_SUCCESS;
+}
+
+// Initialize mutex
+int krhino_mutex_create(kmutex_t *mutex, const char *name) {
+    return kmutex_init(mutex, name, KMUTEX_TYPE_NORMAL);
+}
+
+// Initialize a priority-inheritance mutex: while a thread waits, the
+// kernel runs the owner at the waiter's priority (FUTEX_LOCK_PI).
+// mutex->boosts counts the acquires that went through the kernel while
+// the owner found on entry ran below the waiter's priority, i.e. the
+// owner was boosted for them. Waits that time out or fail are not
+// counted. If the owner exits while holding the lock, later lockers get
+// RHINO_MUTEX_OWNER_ERR.
+int krhino_mutex_create_pi(kmutex_t *mutex, const char *name) {
+    return kmutex_init(mutex, name, KMUTEX_TYPE_PI);
+}
+
+// Initialize a fair mutex: contended waiters queue in arrival order and
+// unlock hands the lock straight to the oldest one, so nobody can barge
+// in ahead of them. Costs a context switch per contended handoff.
+int krhino_mutex_create_fair(kmutex_t *mutex, const char *name) {
+    return kmutex_init(mutex, name, KMUTEX_TYPE_FAIR);
+}
+
+// Contended path: spin for about as long as the lock was recently held,
+// then mark the word contended and park on it until it is released
+static int kmutex_lock_slow(kmutex_t *mutex, const struct timespec *deadline) {
+    int spin = __atomic_load_n(&mutex->spin, __ATOMIC_RELAXED);
+    int max = spin * 2 + 10;
+    int cnt = 0;
+    int c;
+
+    if (max > kmutex_spin_max) {
+        max = kmutex_spin_max;
+    }
+
+    while (cnt++ < max) {
+        kmutex_cpu_relax();
+        c = KMUTEX_UNLOCKED;
+        if (__atomic_load_n(&mutex->state, __ATOMIC_RELAXED) == KMUTEX_UNLOCKED &&
+            __atomic_compare_exchange_n(&mutex->state, &c, KMUTEX_LOCKED, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&mutex->spin, spin + (cnt - spin) / 8, __ATOMIC_RELAXED);
+            return RHINO_SUCCESS;
+        }
+    }
+    if (max > 0) {
+        __atomic_store_n(&mutex->spin, spin + (cnt - spin) / 8, __ATOMIC_RELAXED);
+    }
+
+    while (__atomic_exchange_n(&mutex->state, KMUTEX_CONTENDED, __ATOMIC_ACQUIRE) != KMUTEX_UNLOCKED) {
+        if (kmutex_futex_wait_until(&mutex->state, KMUTEX_CONTENDED, deadline) == ETIMEDOUT) {
+            return RHINO_TIMEOUT;
+        }
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Plain three-state futex lock for the fair-mode queue, held only for a
+// few pointer updates
+static void kmutex_qlock(int *word) {
+    int c = KMUTEX_UNLOCKED;
+
+    if (__atomic_compare_exchange_n(word, &c, KMUTEX_LOCKED, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    while (__atomic_exchange_n(word, KMUTEX_CONTENDED, __ATOMIC_ACQUIRE) != KMUTEX_UNLOCKED) {
+        kmutex_futex_wait(word, KMUTEX_CONTENDED);
+    }
+}
+
+static void kmutex_qunlock(int *word) {
+    if (__atomic_exchange_n(word, KMUTEX_UNLOCKED, __ATOMIC_RELEASE) == KMUTEX_CONTENDED) {
+        kmutex_futex_wake(word, 1);
+    }
+}
+
+// Fair contended path. The word stays KMUTEX_CONTENDED while anyone may
+// be queued, which sends the owner's unlock here to hand over. A waiter
+// that times out unlinks itself, unless the lock was granted first.
+static int kmutex_lock_fair_slow(kmutex_t *mutex, const struct timespec *deadline) {
+    kmutex_waiter_t waiter = { NULL, 0 };
+
+    kmutex_qlock(&mutex->qlock);
+    if (__atomic_exchange_n(&mutex->state, KMUTEX_CONTENDED, __ATOMIC_ACQUIRE) == KMUTEX_UNLOCKED) {
+        kmutex_qunlock(&mutex->qlock);
+        return RHINO_SUCCESS;
+    }
+    if (mutex->tail) {
+        mutex->tail->next = &waiter;
+    } else {
+        mutex->head = &waiter;
+    }
+    mutex->tail = &waiter;
+    kmutex_qunlock(&mutex->qlock);
+
+    while (!__atomic_load_n(&waiter.granted, __ATOMIC_ACQUIRE)) {
+        if (kmutex_futex_wait_until(&waiter.granted, 0, deadline) == ETIMEDOUT) {
+            kmutex_waiter_t *prev = NULL, *w;
+            int granted;
+
+            kmutex_qlock(&mutex->qlock);
+            granted = __atomic_load_n(&waiter.granted, __ATOMIC_ACQUIRE);
+            if (!granted) {
+                for (w = mutex->head; w != &waiter; w = w->next) {
+                    prev = w;
+                }
+                if (prev) {
+                    prev->next = waiter.next;
+                } else {
+                    mutex->head = waiter.next;
+                }
+                if (mutex->tail == &waiter) {
+                    mutex->tail = prev;
+                }
+            }
+            kmutex_qunlock(&mutex->qlock);
+            return granted ? RHINO_SUCCESS : RHINO_TIMEOUT;
+        }
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Hand the lock to the oldest waiter, or release it if none is left. The
+// wake may land after the waiter has returned and reused its stack slot;
+// every futex wait here rechecks its condition, so that is harmless.
+static void kmutex_unlock_fair_slow(kmutex_t *mutex) {
+    kmutex_waiter_t *waiter;
+
+    kmutex_qlock(&mutex->qlock);
+    waiter = mutex->head;
+    if (waiter) {
+        mutex->head = waiter->next;
+        if (mutex->head == NULL) {
+            mutex->tail = NULL;
+            __atomic_store_n(&mutex->state, KMUTEX_LOCKED, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&waiter->granted, 1, __ATOMIC_RELEASE);
+        kmutex_futex_wake(&waiter->granted, 1);
+    } else {
+        __atomic_store_n(&mutex->state, KMUTEX_UNLOCKED, __ATOMIC_RELEASE);
+    }
+    kmutex_qunlock(&mutex->qlock);
+}
+
+static int kmutex_rt_prio(pid_t tid) {
+    struct sched_param param;
+    int policy = sched_getscheduler(tid);
+
+    if ((policy != SCHED_FIFO && policy != SCHED_RR) || sched_getparam(tid, &param) != 0) {
+        return 0;
+    }
+    return param.sched_priority;
+}
+
+// Move a CLOCK_MONOTONIC deadline onto CLOCK_REALTIME, keeping the time
+// left
+static void kmutex_realtime_deadline(const struct timespec *deadline, struct timespec *real) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, real);
+    real->tv_sec += deadline->tv_sec - now.tv_sec;
+    real->tv_nsec += deadline->tv_nsec - now.tv_nsec;
+    if (real->tv_nsec < 0) {
+        real->tv_sec--;
+        real->tv_nsec += 1000000000L;
+    } else if (real->tv_nsec >= 1000000000L) {
+        real->tv_sec++;
+        real->tv_nsec -= 1000000000L;
+    }
+}
+
+// PI contended path: the kernel queues us by priority and boosts the
+// owner until it unlocks. Kernels without FUTEX_LOCK_PI2 only take a
+// CLOCK_REALTIME deadline, so the remaining time is carried over to it.
+// EINTR and EAGAIN retry, ETIMEDOUT is RHINO_TIMEOUT, anything else
+// (ESRCH, EDEADLK, ...: e.g. the owner exited holding the lock) is
+// RHINO_MUTEX_OWNER_ERR.
+static int kmutex_lock_pi_slow(kmutex_t *mutex, const struct timespec *deadline) {
+    const struct timespec *timeout = deadline;
+    struct timespec real;
+    int op = FUTEX_LOCK_PI2 | FUTEX_PRIVATE_FLAG;
+    int c = __atomic_load_n(&mutex->state, __ATOMIC_RELAXED);
+    int boost = kmutex_rt_prio(0) > kmutex_rt_prio(c & FUTEX_TID_MASK);
+
+    while (syscall(SYS_futex, &mutex->state, op, 0, timeout, NULL, 0) != 0) {
+        if (errno == ENOSYS && op != FUTEX_LOCK_PI_PRIVATE) {
+            op = FUTEX_LOCK_PI_PRIVATE;
+            if (deadline) {
+                kmutex_realtime_deadline(deadline, &real);
+                timeout = &real;
+            }
+        } else if (errno == ETIMEDOUT) {
+            return RHINO_TIMEOUT;
+        } else if (errno != EINTR && errno != EAGAIN) {
+            return RHINO_MUTEX_OWNER_ERR;
+        }
+    }
+    // Pairs with the release in unlock; the kernel hands over ownership
+    // without a userspace atomic
+    __atomic_load_n(&mutex->state, __ATOMIC_ACQUIRE);
+    if (boost) {
+        __atomic_fetch_add(&mutex->boosts, 1, __ATOMIC_RELAXED);
+    }
+    return RHINO_SUCCESS;
+}
+
+// Uncontended acquire, a single CAS. PI mutexes store the owner's tid
+// as the locked value.
+static inline int kmutex_acquire(kmutex_t *mutex, pid_t self) {
+    int c = KMUTEX_UNLOCKED;
+
+    return __atomic_compare_exchange_n(&mutex->state, &c,
+                                       mutex->type == KMUTEX_TYPE_PI ? self : KMUTEX_LOCKED,
+                                       0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// Lock mutex. timeout_ms follows krhino_event_get: RHINO_NO_WAIT fails
+// at once with RHINO_NO_PEND_WAIT if the lock is busy, a positive value
+// gives up with RHINO_TIMEOUT after that many ms (CLOCK_MONOTONIC, so
+// wall-clock changes do not affect it), RHINO_WAIT_FOREVER blocks. Any
+// other negative value is a deadline already past: RHINO_TIMEOUT at once
+// if the lock is busy.
+int krhino_mutex_lock(kmutex_t *mutex, int timeout_ms) {
+    struct timespec deadline;
+    pid_t self;
+    int ret;
+    KMUTEX_PROF_DECL(wait);
+
+    if (mutex == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    // Only this thread ever stores its own id here, so a stale read
+    // cannot match
+    self = kmutex_self();
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == self) {
+        mutex->lock_count++;
+        return RHINO_SUCCESS;
+    }
+
+    if (!kmutex_acquire(mutex, self)) {
+        if (timeout_ms == RHINO_NO_WAIT) {
+            return RHINO_NO_PEND_WAIT;
+        }
+        if (timeout_ms < 0 && timeout_ms != RHINO_WAIT_FOREVER) {
+            return RHINO_TIMEOUT;
+        }
+        if (timeout_ms > 0) {
+            kmutex_deadline(&deadline, timeout_ms);
+        }
+
+        KMUTEX_PROF_WAIT(wait);
+        if (mutex->type == KMUTEX_TYPE_PI) {
+            ret = kmutex_lock_pi_slow(mutex, timeout_ms > 0 ? &deadline : NULL);
+        } else if (mutex->type == KMUTEX_TYPE_FAIR) {
+            ret = kmutex_lock_fair_slow(mutex, timeout_ms > 0 ? &deadline : NULL);
+        } else {
+            ret = kmutex_lock_slow(mutex, timeout_ms > 0 ? &deadline : NULL);
+        }
+        if (ret != RHINO_SUCCESS) {
+            return ret;
+        }
+    }
+
+    __atomic_store_n(&mutex->owner, self, __ATOMIC_RELAXED);
+    mutex->lock_count = 1;
+    KMUTEX_PROF_ACQUIRED(mutex, wait);
+    return RHINO_SUCCESS;
+}
+
+// Lock mutex only if that needs no waiting
+int krhino_mutex_trylock(kmutex_t *mutex) {
+    return krhino_mutex_lock(mutex, RHINO_NO_WAIT);
+}
+
+// Unlock mutex
+int krhino_mutex_unlock(kmutex_t *mutex) {
+    if (mutex == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != kmutex_self()) {
+        return RHINO_MUTEX_NOT_OWNER;
+    }
+
+    if (--mutex->lock_count > 0) {
+        return RHINO_SUCCESS;
+    }
+
+    KMUTEX_PROF_RELEASE(mutex);
+    __atomic_store_n(&mutex->owner, 0, __ATOMIC_RELAXED);
+    if (mutex->type == KMUTEX_TYPE_PI) {
+        int self = kmutex_self();
+
+        // FUTEX_WAITERS set: the kernel picks the next owner
+        if (!__atomic_compare_exchange_n(&mutex->state, &self, 0, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            __atomic_fetch_or(&mutex->state, 0, __ATOMIC_RELEASE);
+            syscall(SYS_futex, &mutex->state, FUTEX_UNLOCK_PI_PRIVATE, 0, NULL, NULL, 0);
+        }
+    } else if (mutex->type == KMUTEX_TYPE_FAIR) {
+        int c = KMUTEX_LOCKED;
+
+        if (!__atomic_compare_exchange_n(&mutex->state, &c, KMUTEX_UNLOCKED, 0,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            kmutex_unlock_fair_slow(mutex);
+        }
+    } else if (__atomic_exchange_n(&mutex->state, KMUTEX_UNLOCKED, __ATOMIC_RELEASE) == KMUTEX_CONTENDED) {
+        kmutex_futex_wake(&mutex->state, 1);
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Delete mutex
+int krhino_mutex_del(kmutex_t *mutex) {
+    if (mutex == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    printf("Deleting mutex '%s'\n", mutex->name);
+    return RHINO_SUCCESS;
+}
+
+// Reader-writer lock with writer preference. Readers count themselves in
+// one of KRWLOCK_SLOTS cache-line-sized slots, picked once per thread, so
+// concurrent readers mostly write different lines. A writer first
+// announces itself in writers, which turns new readers away, then takes
+// wmutex and waits for every slot to drain. Readers park on wake_gen,
+// which the last writer out bumps, until no writer is waiting or active.
+// Waiting on a generation rather than on writers itself means a reader
+// about to sleep cannot miss an unlock just because another writer
+// brought writers back to the value it saw.
+//
+// Each thread keeps its read depth per rwlock in a small table, so
+// unlock can tell a reader from a thread holding nothing, and a nested
+// rdlock goes straight in instead of queueing behind a writer that is
+// itself waiting for this thread's first hold.
+#define KRWLOCK_SLOTS           16
+#define KRWLOCK_HELD_MAX        8   // Distinct rwlocks one thread can hold for reading
+
+typedef struct {
+    int readers;
+} __attribute__((aligned(64))) krwlock_slot_t;
+
+typedef struct {
+    krwlock_slot_t slot[KRWLOCK_SLOTS];
+    int writers;        // Writers waiting or holding
+    int wake_gen;       // Bumped when writers drops to 0, futex word for parked readers
+    int parked;         // Readers parked or about to park on wake_gen
+    pid_t owner;        // Writer holding the lock, 0 when none
+    int wdepth;         // Nested wrlocks by owner, only touched by the owner
+    kmutex_t wmutex;    // Serializes writers
+    const char *name;
+} krwlock_t;
+
+typedef struct {
+    krwlock_t *rwlock;
+    int depth;          // Read locks this thread holds on rwlock, 0 marks a free entry
+} krwlock_held_t;
+
+static int krwlock_next_slot;
+static __thread int krwlock_slot = -1;
+static __thread krwlock_held_t krwlock_held[KRWLOCK_HELD_MAX];
+
+// This thread's read depth entry for rwlock, NULL if it holds no read lock on it
+static inline krwlock_held_t *krwlock_held_find(krwlock_t *rwlock) {
+    for (int i = 0; i < KRWLOCK_HELD_MAX; i++) {
+        if (krwlock_held[i].depth != 0 && krwlock_held[i].rwlock == rwlock) {
+            return &krwlock_held[i];
+        }
+    }
+    return NULL;
+}
+
+static inline krwlock_held_t *krwlock_held_alloc(krwlock_t *rwlock) {
+    for (int i = 0; i < KRWLOCK_HELD_MAX; i++) {
+        if (krwlock_held[i].depth == 0) {
+            krwlock_held[i].rwlock = rwlock;
+            return &krwlock_held[i];
+        }
+    }
+    return NULL;
+}
+
+static inline krwlock_slot_t *krwlock_my_slot(krwlock_t *rwlock) {
+    if (krwlock_slot < 0) {
+        krwlock_slot = __atomic_fetch_add(&krwlock_next_slot, 1, __ATOMIC_RELAXED) % KRWLOCK_SLOTS;
+    }
+    return &rwlock->slot[krwlock_slot];
+}
+
+// Initialize rwlock
+int krhino_rwlock_create(krwlock_t *rwlock, const char *name) {
+    if (rwlock == NULL || name == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    memset(rwlock->slot, 0, sizeof(rwlock->slot));
+    rwlock->writers = 0;
+    rwlock->wake_gen = 0;
+    rwlock->parked = 0;
+    rwlock->owner = 0;
+    rwlock->wdepth = 0;
+    rwlock->name = name;
+
+    return krhino_mutex_create(&rwlock->wmutex, name);
+}
+
+// Lock for reading. The slot increment and the writers check are both
+// sequentially consistent, pairing with the writer's announce-then-scan:
+// either the reader sees the writer and backs out, or the writer sees
+// the reader and waits for it. A thread already reading this rwlock
+// nests without the check. The write holder gets RHINO_MUTEX_OWNER_ERR,
+// and a thread already reading KRWLOCK_HELD_MAX other rwlocks gets
+// RHINO_NO_MEM.
+int krhino_rwlock_rdlock(krwlock_t *rwlock) {
+    krwlock_slot_t *slot;
+    krwlock_held_t *held;
+    int gen;
+
+    if (rwlock == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    slot = krwlock_my_slot(rwlock);
+    held = krwlock_held_find(rwlock);
+    if (held != NULL) {
+        __atomic_fetch_add(&slot->readers, 1, __ATOMIC_RELAXED);
+        held->depth++;
+        return RHINO_SUCCESS;
+    }
+
+    if (__atomic_load_n(&rwlock->owner, __ATOMIC_RELAXED) == kmutex_self()) {
+        return RHINO_MUTEX_OWNER_ERR;
+    }
+    held = krwlock_held_alloc(rwlock);
+    if (held == NULL) {
+        return RHINO_NO_MEM;
+    }
+
+    for (;;) {
+        __atomic_fetch_add(&slot->readers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&rwlock->writers, __ATOMIC_SEQ_CST) == 0) {
+            held->depth = 1;
+            return RHINO_SUCCESS;
+        }
+
+        // A writer is waiting or active: step aside for it
+        if (__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST) == 0) {
+            kmutex_futex_wake(&slot->readers, 1);
+        }
+
+        // Counted in parked before sampling wake_gen: a writer that then
+        // sees parked == 0 has bumped wake_gen before our sample, and any
+        // later writer will see us counted
+        __atomic_fetch_add(&rwlock->parked, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            gen = __atomic_load_n(&rwlock->wake_gen, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&rwlock->writers, __ATOMIC_SEQ_CST) == 0) {
+                break;
+            }
+            kmutex_futex_wait(&rwlock->wake_gen, gen);
+        }
+        __atomic_fetch_sub(&rwlock->parked, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Lock for writing. The write holder nests, and must unlock as many
+// times. A thread holding it for reading gets RHINO_MUTEX_OWNER_ERR, as
+// waiting for its own read lock to drain would never return.
+int krhino_rwlock_wrlock(krwlock_t *rwlock) {
+    int r;
+
+    if (rwlock == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    // Only this thread ever stores its own id here
+    if (__atomic_load_n(&rwlock->owner, __ATOMIC_RELAXED) == kmutex_self()) {
+        rwlock->wdepth++;
+        return RHINO_SUCCESS;
+    }
+    if (krwlock_held_find(rwlock) != NULL) {
+        return RHINO_MUTEX_OWNER_ERR;
+    }
+
+    __atomic_fetch_add(&rwlock->writers, 1, __ATOMIC_SEQ_CST);
+    krhino_mutex_lock(&rwlock->wmutex, RHINO_WAIT_FOREVER);
+    for (int i = 0; i < KRWLOCK_SLOTS; i++) {
+        while ((r = __atomic_load_n(&rwlock->slot[i].readers, __ATOMIC_SEQ_CST)) != 0) {
+            kmutex_futex_wait(&rwlock->slot[i].readers, r);
+        }
+    }
+    rwlock->wdepth = 1;
+    __atomic_store_n(&rwlock->owner, kmutex_self(), __ATOMIC_RELAXED);
+
+    return RHINO_SUCCESS;
+}
+
+// Unlock, whichever way the calling thread holds it. A thread holding
+// neither side gets RHINO_MUTEX_NOT_OWNER.
+int krhino_rwlock_unlock(krwlock_t *rwlock) {
+    krwlock_slot_t *slot;
+    krwlock_held_t *held;
+
+    if (rwlock == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    if (__atomic_load_n(&rwlock->owner, __ATOMIC_RELAXED) == kmutex_self()) {
+        if (--rwlock->wdepth > 0) {
+            return RHINO_SUCCESS;
+        }
+        __atomic_store_n(&rwlock->owner, 0, __ATOMIC_RELAXED);
+        krhino_mutex_unlock(&rwlock->wmutex);
+        if (__atomic_sub_fetch(&rwlock->writers, 1, __ATOMIC_SEQ_CST) == 0) {
+            __atomic_fetch_add(&rwlock->wake_gen, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&rwlock->parked, __ATOMIC_SEQ_CST) != 0) {
+                kmutex_futex_wake(&rwlock->wake_gen, INT32_MAX);
+            }
+        }
+        return RHINO_SUCCESS;
+    }
+
+    held = krwlock_held_find(rwlock);
+    if (held == NULL) {
+        return RHINO_MUTEX_NOT_OWNER;
+    }
+    held->depth--;
+
+    // Last reader out of a slot wakes a writer draining it
+    slot = krwlock_my_slot(rwlock);
+    if (__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&rwlock->writers, __ATOMIC_SEQ_CST) != 0) {
+        kmutex_futex_wake(&slot->readers, 1);
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Delete rwlock
+int krhino_rwlock_del(krwlock_t *rwlock) {
+    if (rwlock == NULL) {
+        return RHINO_NULL_PTR;
+    }
+
+    return krhino_mutex_del(&rwlock->wmutex);
+}
+
+// Shared resource
+int shared_counter = 0;
+
+// Test function for threads
+void* test_thread(void* arg) {
+    kmutex_t* mutex = (kmutex_t*)arg;
+    int i;
+    
+    for (i = 0; i < 3; i++) {
+        // Lock mutex
+        if (krhino_mutex_lock(mutex, RHINO_WAIT_FOREVER) != RHINO_SUCCESS) {
+            printf("Thread %lu failed to lock mutex\n", (unsigned long)pthread_self());
+            continue;
+        }
+
+        // Access shared resource
+        shared_counter++;
+        printf("Thread %lu: counter = %d\n", (unsigned long)pthread_self(), shared_counter);
+        
+        // Simulate some work
+        usleep(100000);  // 100ms
+
+        // Test recursive locking
+        if (i == 1) {  // On second iteration
+            printf("Thread %lu testing recursive lock\n", (unsigned long)pthread_self());
+            krhino_mutex_lock(mutex, RHINO_WAIT_FOREVER);
+            shared_counter++;
+            printf("Thread %lu: counter = %d (recursive)\n", 
+                   (unsigned long)pthread_self(), shared_counter);
+            krhino_mutex_unlock(mutex);
+        }
+
+        // Unlock mutex
+        krhino_mutex_unlock(mutex);
+        
+        // Small delay between iterations
+        usleep(50000);  // 50ms
+    }
+
+    return NULL;
+}
+
+static void test_mutex_create(kmutex_t *mutex, const char *name, int type) {
+    if (type == KMUTEX_TYPE_PI) {
+        krhino_mutex_create_pi(mutex, name);
+    } else if (type == KMUTEX_TYPE_FAIR) {
+        krhino_mutex_create_fair(mutex, name);
+    } else {
+        krhino_mutex_create(mutex, name);
+    }
+}
+
+#define TEST_MUTEX_THREADS      8
+#define TEST_MUTEX_ITERS        100000
+
+static long stress_counter;
+
+static void *test_stress_thread(void *arg) {
+    kmutex_t *mutex = (kmutex_t *)arg;
+
+    for (int i = 0; i < TEST_MUTEX_ITERS; i++) {
+        krhino_mutex_lock(mutex, RHINO_WAIT_FOREVER);
+        stress_counter++;
+        if (i % 16 == 0) {
+            krhino_mutex_lock(mutex, RHINO_WAIT_FOREVER);
+            stress_counter++;
+            krhino_mutex_unlock(mutex);
+        }
+        krhino_mutex_unlock(mutex);
+    }
+
+    return NULL;
+}
+
+static void *test_not_owner_thread(void *arg) {
+    return (void *)(intptr_t)krhino_mutex_unlock((kmutex_t *)arg);
+}
+
+// Threads hammer one mutex with nested acquires mixed in; no increment
+// may be lost, and only the owner may unlock
+void test_mutex_stress(int type) {
+    pthread_t threads[TEST_MUTEX_THREADS];
+    long expect = (long)TEST_MUTEX_THREADS * (TEST_MUTEX_ITERS + (TEST_MUTEX_ITERS + 15) / 16);
+    kmutex_t mutex;
+    void *ret;
+    int errors = 0;
+
+    printf("\nTesting contended mutex (%d threads)...\n", TEST_MUTEX_THREADS);
+    test_mutex_create(&mutex, "stress_mutex", type);
+    stress_counter = 0;
+
+    for (int i = 0; i < TEST_MUTEX_THREADS; i++) {
+        pthread_create(&threads[i], NULL, test_stress_thread, &mutex);
+    }
+    for (int i = 0; i < TEST_MUTEX_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (stress_counter != expect || mutex.state != KMUTEX_UNLOCKED || mutex.owner != 0) {
+        errors++;
+    }
+
+    krhino_mutex_lock(&mutex, RHINO_WAIT_FOREVER);
+    pthread_create(&threads[0], NULL, test_not_owner_thread, &mutex);
+    pthread_join(threads[0], &ret);
+    if ((intptr_t)ret != RHINO_MUTEX_NOT_OWNER || mutex.lock_count != 1) {
+        errors++;
+    }
+    krhino_mutex_unlock(&mutex);
+    if (krhino_mutex_unlock(&mutex) != RHINO_MUTEX_NOT_OWNER) {
+        errors++;
+    }
+
+    krhino_mutex_del(&mutex);
+    printf("counter %ld (expected %ld), %d errors\n", stress_counter, expect, errors);
+}
+
+// Priority inversion on one CPU: low holds the lock for TEST_PI_HOLD_MS
+// of CPU time, high blocks on it, and medium then burns
+// TEST_PI_SPIN_MS. Without PI, medium preempts the holder and high waits
+// for both; with PI, the holder runs at high's priority and finishes
+// first. Needs SCHED_FIFO (root or CAP_SYS_NICE).
+#define TEST_PI_ROUNDS          5
+#define TEST_PI_HOLD_MS         10
+#define TEST_PI_SPIN_MS         40
+#define TEST_PI_PRIO_LOW        10
+#define TEST_PI_PRIO_MID        20
+#define TEST_PI_PRIO_HIGH       30
+#define TEST_PI_PRIO_MAIN       40
+
+static kmutex_t *pi_mutex;
+static int pi_locked;
+static uint64_t pi_wait_ns;
+
+static uint64_t test_now_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Burn CPU time, not wall time, so preemption stretches it
+static void test_burn_ms(int ms) {
+    uint64_t end = test_now_ns(CLOCK_THREAD_CPUTIME_ID) + (uint64_t)ms * 1000000;
+
+    while (test_now_ns(CLOCK_THREAD_CPUTIME_ID) < end) {
+    }
+}
+
+static void *test_pi_low(void *arg) {
+    (void)arg;
+    krhino_mutex_lock(pi_mutex, RHINO_WAIT_FOREVER);
+    __atomic_store_n(&pi_locked, 1, __ATOMIC_RELEASE);
+    test_burn_ms(TEST_PI_HOLD_MS);
+    krhino_mutex_unlock(pi_mutex);
+    return NULL;
+}
+
+static void *test_pi_mid(void *arg) {
+    (void)arg;
+    test_burn_ms(TEST_PI_SPIN_MS);
+    return NULL;
+}
+
+static void *test_pi_high(void *arg) {
+    uint64_t start = test_now_ns(CLOCK_MONOTONIC);
+
+    (void)arg;
+    krhino_mutex_lock(pi_mutex, RHINO_WAIT_FOREVER);
+    pi_wait_ns = test_now_ns(CLOCK_MONOTONIC) - start;
+    krhino_mutex_unlock(pi_mutex);
+    return NULL;
+}
+
+static int test_pi_spawn(pthread_t *thread, void *(*fn)(void *), int prio) {
+    struct sched_param param = { .sched_priority = prio };
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    int ret;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    ret = pthread_create(thread, &attr, fn, NULL);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+// Worst-case high-priority wait over TEST_PI_ROUNDS, in ns
+static uint64_t test_pi_run(kmutex_t *mutex) {
+    struct timespec settle = { 0, 2000000 };
+    pthread_t low, mid, high;
+    uint64_t worst = 0;
+
+    pi_mutex = mutex;
+    for (int r = 0; r < TEST_PI_ROUNDS; r++) {
+        __atomic_store_n(&pi_locked, 0, __ATOMIC_RELAXED);
+        test_pi_spawn(&low, test_pi_low, TEST_PI_PRIO_LOW);
+        while (!__atomic_load_n(&pi_locked, __ATOMIC_ACQUIRE)) {
+            nanosleep(&settle, NULL);
+        }
+        // Main outranks all three, so high blocks before medium starts
+        test_pi_spawn(&high, test_pi_high, TEST_PI_PRIO_HIGH);
+        test_pi_spawn(&mid, test_pi_mid, TEST_PI_PRIO_MID);
+        pthread_join(high, NULL);
+        pthread_join(mid, NULL);
+        pthread_join(low, NULL);
+        if (pi_wait_ns > worst) {
+            worst = pi_wait_ns;
+        }
+    }
+
+    return worst;
+}
+
+static void *test_pi_exit_locked(void *arg) {
+    krhino_mutex_lock((kmutex_t *)arg, RHINO_WAIT_FOREVER);
+    return NULL;
+}
+
+// A PI mutex whose owner exited while holding it: every later lock must
+// fail instead of pretending to own it
+void test_mutex_pi_dead_owner(void) {
+    pthread_t thread;
+    kmutex_t mutex;
+    int errors = 0;
+
+    printf("\nTesting PI mutex with a dead owner...\n");
+    krhino_mutex_create_pi(&mutex, "dead_owner_mutex");
+    pthread_create(&thread, NULL, test_pi_exit_locked, &mutex);
+    pthread_join(thread, NULL);
+
+    for (int i = 0; i < 2; i++) {
+        if (krhino_mutex_lock(&mutex, RHINO_WAIT_FOREVER) != RHINO_MUTEX_OWNER_ERR || mutex.owner == kmutex_self()) {
+            errors++;
+        }
+    }
+    // Timed and try variants fail the same way, never as success
+    if (krhino_mutex_lock(&mutex, 50) != RHINO_MUTEX_OWNER_ERR ||
+        krhino_mutex_trylock(&mutex) != RHINO_NO_PEND_WAIT || mutex.owner == kmutex_self()) {
+        errors++;
+    }
+    if (krhino_mutex_unlock(&mutex) != RHINO_MUTEX_NOT_OWNER || mutex.boosts != 0) {
+        errors++;
+    }
+
+    krhino_mutex_del(&mutex);
+    printf("%d errors\n", errors);
+}
+
+void test_mutex_pi(void) {
+    struct sched_param param = { .sched_priority = TEST_PI_PRIO_MAIN };
+    struct sched_param normal = { .sched_priority = 0 };
+    cpu_set_t cpus, saved;
+    kmutex_t plain, pi;
+    uint64_t plain_ns, pi_ns;
+    int errors = 0;
+
+    printf("\nTesting priority inversion (hold %d ms, medium spin %d ms)...\n",
+           TEST_PI_HOLD_MS, TEST_PI_SPIN_MS);
+    pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved);
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        printf("skipped: SCHED_FIFO not permitted\n");
+        return;
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    krhino_mutex_create(&plain, "inversion_mutex");
+    krhino_mutex_create_pi(&pi, "inversion_mutex_pi");
+    plain_ns = test_pi_run(&plain);
+    pi_ns = test_pi_run(&pi);
+
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &normal);
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+
+    if (pi.boosts != TEST_PI_ROUNDS || plain.boosts != 0 || pi_ns >= plain_ns) {
+        errors++;
+    }
+    printf("worst high-priority wait: %.1f ms without PI, %.1f ms with PI (%d boosts), %d errors\n",
+           plain_ns / 1e6, pi_ns / 1e6, pi.boosts, errors);
+    krhino_mutex_del(&pi);
+    krhino_mutex_del(&plain);
+}
+
+#define TEST_TIMED_MS           50
+#define TEST_FIFO_WAITERS       4
+
+typedef struct {
+    kmutex_t *mutex;
+    int timeout_ms;
+    int ret;
+    int order;
+    uint64_t waited_ns;
+} test_timed_arg_t;
 
-// Initialize mutex
-int krhino_mutex_create(kmutex_t *mutex, const char *name) {
-    if (mutex == NULL || name == NULL) {
-        return RHINO_NULL_PTR;
+static int test_fifo_seq;
+
+static void *test_timed_thread(void *arg) {
+    test_timed_arg_t *p_arg = arg;
+    uint64_t start = test_now_ns(CLOCK_MONOTONIC);
+
+    p_arg->ret = krhino_mutex_lock(p_arg->mutex, p_arg->timeout_ms);
+    p_arg->waited_ns = test_now_ns(CLOCK_MONOTONIC) - start;
+    if (p_arg->ret == RHINO_SUCCESS) {
+        p_arg->order = __atomic_add_fetch(&test_fifo_seq, 1, __ATOMIC_RELAXED);
+        krhino_mutex_unlock(p_arg->mutex);
+    }
+    return NULL;
+}
+
+static void test_timed_spawn(pthread_t *thread, test_timed_arg_t *arg, kmutex_t *mutex, int timeout_ms) {
+    arg->mutex = mutex;
+    arg->timeout_ms = timeout_ms;
+    arg->ret = -1;
+    arg->order = 0;
+    pthread_create(thread, NULL, test_timed_thread, arg);
+}
+
+// trylock and timed lock against a held mutex, for every mutex type: no
+// wait, a negative timeout that fails at once, a timeout that expires on
+// schedule, and one that is satisfied by the unlock
+static int test_mutex_timed_type(int type) {
+    struct timespec settle = { 0, 20000000 };
+    test_timed_arg_t arg;
+    pthread_t thread;
+    kmutex_t mutex;
+    int errors = 0;
+
+    test_mutex_create(&mutex, "timed_mutex", type);
+    if (krhino_mutex_trylock(&mutex) != RHINO_SUCCESS || krhino_mutex_trylock(&mutex) != RHINO_SUCCESS ||
+        mutex.lock_count != 2) {
+        errors++;
+    }
+    krhino_mutex_unlock(&mutex);
+
+    test_timed_spawn(&thread, &arg, &mutex, RHINO_NO_WAIT);
+    pthread_join(thread, NULL);
+    if (arg.ret != RHINO_NO_PEND_WAIT) {
+        errors++;
+    }
+
+    test_timed_spawn(&thread, &arg, &mutex, -5);
+    pthread_join(thread, NULL);
+    if (arg.ret != RHINO_TIMEOUT) {
+        errors++;
+    }
+
+    test_timed_spawn(&thread, &arg, &mutex, TEST_TIMED_MS);
+    pthread_join(thread, NULL);
+    if (arg.ret != RHINO_TIMEOUT || arg.waited_ns < TEST_TIMED_MS * 1000000ull ||
+        arg.waited_ns > TEST_TIMED_MS * 10000000ull) {
+        errors++;
+    }
+
+    test_timed_spawn(&thread, &arg, &mutex, 10 * TEST_TIMED_MS);
+    nanosleep(&settle, NULL);
+    krhino_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    if (arg.ret != RHINO_SUCCESS || mutex.state != KMUTEX_UNLOCKED) {
+        errors++;
+    }
+
+    krhino_mutex_del(&mutex);
+    return errors;
+}
+
+// Fair mode: queued waiters get the lock in arrival order, and one that
+// times out in the middle of the queue drops out without holding it up
+static int test_mutex_fifo(void) {
+    struct timespec settle = { 0, 10000000 };
+    struct timespec expire = { 0, 3 * TEST_TIMED_MS * 1000000L };
+    test_timed_arg_t args[TEST_FIFO_WAITERS];
+    pthread_t threads[TEST_FIFO_WAITERS];
+    kmutex_t mutex;
+    int errors = 0, expect = 1;
+
+    krhino_mutex_create_fair(&mutex, "fifo_mutex");
+    krhino_mutex_lock(&mutex, RHINO_WAIT_FOREVER);
+    test_fifo_seq = 0;
+    for (int i = 0; i < TEST_FIFO_WAITERS; i++) {
+        test_timed_spawn(&threads[i], &args[i], &mutex, i == 1 ? TEST_TIMED_MS : RHINO_WAIT_FOREVER);
+        nanosleep(&settle, NULL);
+    }
+    nanosleep(&expire, NULL);
+    krhino_mutex_unlock(&mutex);
+
+    for (int i = 0; i < TEST_FIFO_WAITERS; i++) {
+        pthread_join(threads[i], NULL);
+        if (i == 1) {
+            if (args[i].ret != RHINO_TIMEOUT) {
+                errors++;
+            }
+        } else if (args[i].ret != RHINO_SUCCESS || args[i].order != expect++) {
+            errors++;
+        }
+    }
+    if (mutex.state != KMUTEX_UNLOCKED || mutex.head != NULL || mutex.tail != NULL) {
+        errors++;
+    }
+
+    krhino_mutex_del(&mutex);
+    return errors;
+}
+
+void test_mutex_timed(void) {
+    int errors = 0;
+
+    printf("\nTesting trylock, timed lock and fair mode...\n");
+    errors += test_mutex_timed_type(KMUTEX_TYPE_NORMAL);
+    errors += test_mutex_timed_type(KMUTEX_TYPE_PI);
+    errors += test_mutex_timed_type(KMUTEX_TYPE_FAIR);
+    errors += test_mutex_fifo();
+    printf("%d errors\n", errors);
+}
+
+#ifdef KMUTEX_PROFILE
+#define TEST_PROF_THREADS       4
+#define TEST_PROF_ITERS         20000
+
+static void *test_prof_thread(void *arg) {
+    kmutex_t *mutex = (kmutex_t *)arg;
+    volatile int work = 0;
+
+    for (int i = 0; i < TEST_PROF_ITERS; i++) {
+        krhino_mutex_lock(mutex, RHINO_WAIT_FOREVER);
+        for (int j = 0; j < i % 64; j++) {
+            work++;
+        }
+        krhino_mutex_unlock(mutex);
+    }
+
+    return NULL;
+}
+
+// Two mutexes sharing a name fold into one entry; every acquire lands in
+// exactly one wait bucket and one hold bucket, including those of
+// threads that have exited, whose blocks are gone (only main's is left)
+void test_mutex_profile(void) {
+    pthread_t threads[TEST_PROF_THREADS];
+    kmutex_t first, second;
+    kmutex_prof_stat_t sum;
+    uint64_t waits = 0, holds = 0;
+    pid_t holder;
+    int errors = 0, live = 0;
+
+    printf("\nTesting mutex profiling (%d threads)...\n", TEST_PROF_THREADS);
+    krhino_mutex_create(&first, "prof_mutex");
+    krhino_mutex_create(&second, "prof_mutex");
+    if (first.prof_id < 0 || first.prof_id != second.prof_id) {
+        errors++;
+    }
+
+    for (int i = 0; i < TEST_PROF_THREADS; i++) {
+        pthread_create(&threads[i], NULL, test_prof_thread, i % 2 ? &second : &first);
+    }
+    for (int i = 0; i < TEST_PROF_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&kmutex_prof_lock);
+    kmutex_prof_sum(first.prof_id, &sum, &holder);
+    for (kmutex_prof_thread_t *t = kmutex_prof_threads; t != NULL; t = t->next) {
+        live++;
+    }
+    pthread_mutex_unlock(&kmutex_prof_lock);
+    for (int b = 0; b < KMUTEX_PROF_BUCKETS; b++) {
+        waits += sum.wait_hist[b];
+        holds += sum.hold_hist[b];
+    }
+    if (sum.acquires != (uint64_t)TEST_PROF_THREADS * TEST_PROF_ITERS || waits != sum.acquires ||
+        holds != sum.acquires || sum.contended > sum.acquires || holder == 0 || live > 1) {
+        errors++;
+    }
+
+    krhino_mutex_prof_dump();
+    krhino_mutex_del(&second);
+    krhino_mutex_del(&first);
+    printf("%llu acquires, %d errors\n", (unsigned long long)sum.acquires, errors);
+}
+#endif
+
+#define TEST_RW_THREADS         8
+#define TEST_RW_ITERS           50000
+#define TEST_RW_TABLE           16
+
+static krwlock_t test_rw;
+static int test_rw_table[TEST_RW_TABLE];
+static int test_rw_errors;
+static int test_rw_order[2];
+static int test_rw_seq;
+
+// Writers fill the table with one value; readers must never see a mix
+static void *test_rw_thread(void *arg) {
+    uint64_t seed = (uintptr_t)arg * 0x9e3779b97f4a7c15ull + 1;
+    int errors = 0, value;
+
+    for (int i = 0; i < TEST_RW_ITERS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        if (seed % 10 == 0) {
+            krhino_rwlock_wrlock(&test_rw);
+            value = test_rw_table[0] + 1;
+            for (int j = 0; j < TEST_RW_TABLE; j++) {
+                test_rw_table[j] = value;
+            }
+            krhino_rwlock_unlock(&test_rw);
+        } else {
+            krhino_rwlock_rdlock(&test_rw);
+            for (int j = 1; j < TEST_RW_TABLE; j++) {
+                if (test_rw_table[j] != test_rw_table[0]) {
+                    errors++;
+                }
+            }
+            krhino_rwlock_unlock(&test_rw);
+        }
+    }
+    __atomic_fetch_add(&test_rw_errors, errors, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+static void *test_rw_writer(void *arg) {
+    (void)arg;
+    krhino_rwlock_wrlock(&test_rw);
+    test_rw_order[0] = __atomic_add_fetch(&test_rw_seq, 1, __ATOMIC_RELAXED);
+    krhino_rwlock_unlock(&test_rw);
+    return NULL;
+}
+
+static void *test_rw_reader(void *arg) {
+    (void)arg;
+    krhino_rwlock_rdlock(&test_rw);
+    test_rw_order[1] = __atomic_add_fetch(&test_rw_seq, 1, __ATOMIC_RELAXED);
+    krhino_rwlock_unlock(&test_rw);
+    return NULL;
+}
+
+static int test_rw_reader_done;
+
+static void *test_rw_parked_reader(void *arg) {
+    (void)arg;
+    krhino_rwlock_rdlock(&test_rw);
+    __atomic_store_n(&test_rw_reader_done, 1, __ATOMIC_RELEASE);
+    krhino_rwlock_unlock(&test_rw);
+    return NULL;
+}
+
+// Unlock by a thread holding neither side is refused, even while it reads
+// another rwlock. Both sides nest: a nested wrlock needs a matching
+// unlock, and a nested rdlock gets in ahead of a queued writer. Taking
+// the other side while holding one is refused.
+static int test_rwlock_nesting(void) {
+    struct timespec settle = { 0, 20000000 };
+    krwlock_t other;
+    pthread_t thread;
+    int errors = 0;
+
+    krhino_rwlock_create(&test_rw, "nested_rwlock");
+    krhino_rwlock_create(&other, "other_rwlock");
+
+    if (krhino_rwlock_unlock(&test_rw) != RHINO_MUTEX_NOT_OWNER) {
+        errors++;
+    }
+    krhino_rwlock_rdlock(&other);
+    if (krhino_rwlock_unlock(&test_rw) != RHINO_MUTEX_NOT_OWNER) {
+        errors++;
+    }
+    if (krhino_rwlock_wrlock(&other) != RHINO_MUTEX_OWNER_ERR) {
+        errors++;
+    }
+    krhino_rwlock_unlock(&other);
+
+    krhino_rwlock_wrlock(&test_rw);
+    if (krhino_rwlock_wrlock(&test_rw) != RHINO_SUCCESS ||
+        krhino_rwlock_rdlock(&test_rw) != RHINO_MUTEX_OWNER_ERR) {
+        errors++;
+    }
+    krhino_rwlock_unlock(&test_rw);
+    if (krhino_rwlock_unlock(&test_rw) != RHINO_SUCCESS || test_rw.writers != 0 ||
+        krhino_rwlock_unlock(&test_rw) != RHINO_MUTEX_NOT_OWNER) {
+        errors++;
+    }
+
+    // Both would hang if the counts above had been corrupted
+    krhino_rwlock_wrlock(&other);
+    krhino_rwlock_unlock(&other);
+    krhino_rwlock_rdlock(&test_rw);
+    test_rw_seq = 0;
+    pthread_create(&thread, NULL, test_rw_writer, NULL);
+    nanosleep(&settle, NULL);
+    if (krhino_rwlock_rdlock(&test_rw) != RHINO_SUCCESS || test_rw_seq != 0) {
+        errors++;
+    }
+    krhino_rwlock_unlock(&test_rw);
+    krhino_rwlock_unlock(&test_rw);
+    pthread_join(thread, NULL);
+    if (test_rw_seq != 1) {
+        errors++;
+    }
+
+    krhino_rwlock_del(&other);
+    krhino_rwlock_del(&test_rw);
+    return errors;
+}
+
+// A parked reader, while one writer unlocks and a second one
+// immediately takes over, must still be woken by the second unlock
+static int test_rwlock_back_to_back(void) {
+    struct timespec poll = { 0, 1000000 }, settle = { 0, 100000000 };
+    struct timespec deadline;
+    pthread_t thread;
+    int errors = 0;
+
+    krhino_rwlock_create(&test_rw, "parked_rwlock");
+    krhino_rwlock_wrlock(&test_rw);
+    pthread_create(&thread, NULL, test_rw_parked_reader, NULL);
+    while (!__atomic_load_n(&test_rw.parked, __ATOMIC_SEQ_CST)) {
+        nanosleep(&poll, NULL);
+    }
+
+    krhino_rwlock_unlock(&test_rw);
+    krhino_rwlock_wrlock(&test_rw);
+    nanosleep(&settle, NULL);
+    krhino_rwlock_unlock(&test_rw);
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 2;
+    if (pthread_timedjoin_np(thread, NULL, &deadline) != 0) {
+        errors++;
+        pthread_detach(thread);
+    } else {
+        krhino_rwlock_del(&test_rw);
+    }
+    if (!__atomic_load_n(&test_rw_reader_done, __ATOMIC_ACQUIRE)) {
+        errors++;
+    }
+
+    return errors;
+}
+
+// Mixed readers and writers keep the table consistent; a waiting writer
+// goes ahead of a reader that arrives after it, nesting and unlock by a
+// non-holder behave, and a parking reader is not lost between
+// back-to-back writers
+void test_rwlock(void) {
+    struct timespec settle = { 0, 20000000 };
+    pthread_t threads[TEST_RW_THREADS];
+    int errors;
+
+    printf("\nTesting rwlock (%d threads, 10%% writes)...\n", TEST_RW_THREADS);
+    krhino_rwlock_create(&test_rw, "test_rwlock");
+
+    for (int i = 0; i < TEST_RW_THREADS; i++) {
+        pthread_create(&threads[i], NULL, test_rw_thread, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < TEST_RW_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    errors = test_rw_errors;
+
+    krhino_rwlock_rdlock(&test_rw);
+    pthread_create(&threads[0], NULL, test_rw_writer, NULL);
+    nanosleep(&settle, NULL);
+    pthread_create(&threads[1], NULL, test_rw_reader, NULL);
+    nanosleep(&settle, NULL);
+    if (test_rw_seq != 0) {
+        errors++;
+    }
+    krhino_rwlock_unlock(&test_rw);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    if (test_rw_order[0] != 1 || test_rw_order[1] != 2) {
+        errors++;
     }
 
+    krhino_rwlock_del(&test_rw);
+    errors += test_rwlock_nesting();
+    errors += test_rwlock_back_to_back();
+    printf("table value %d, %d errors\n", test_rw_table[0], errors);
+}
+
+// Baseline for the benchmark: the previous wrapper around a recursive
+// pthread mutex, minus its per-call printf
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_t owner;
+    int lock_count;
+} bench_pmutex_t;
+
+static void bench_pmutex_create(bench_pmutex_t *mutex) {
     pthread_mutexattr_t attr;
+
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    
-    int ret = pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutex_init(&mutex->mutex, &attr);
     pthread_mutexattr_destroy(&attr);
-    
-    if (ret != 0) {
-        return RHINO_NULL_PTR;
-    }
-
-    mutex->name = name;
     mutex->owner = 0;
     mutex->lock_count = 0;
-    
-    printf("Mutex '%s' created\n", name);
-    return RHINO_SUCCESS;
 }
 
-// Lock mutex
-int krhino_mutex_lock(kmutex_t *mutex) {
-    if (mutex == NULL) {
-        return RHINO_NULL_PTR;
+static void bench_pmutex_lock(bench_pmutex_t *mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+    mutex->owner = pthread_self();
+    mutex->lock_count++;
+}
+
+static void bench_pmutex_unlock(bench_pmutex_t *mutex) {
+    if (--mutex->lock_count == 0) {
+        mutex->owner = 0;
     }
+    pthread_mutex_unlock(&mutex->mutex);
+}
 
-    int ret = pthread_mutex_lock(&mutex->mutex);
-    if (ret != 0) {
-        return RHINO_MUTEX_OWNER_ERR;
+#define BENCH_MUTEX_OPS         2000000
+
+typedef struct {
+    kmutex_t *kmutex;
+    bench_pmutex_t *pmutex;
+    long ops;
+    volatile long *counter;
+} bench_mutex_arg_t;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *bench_mutex_thread(void *arg) {
+    bench_mutex_arg_t *p_arg = arg;
+
+    for (long i = 0; i < p_arg->ops; i++) {
+        if (p_arg->kmutex) {
+            krhino_mutex_lock(p_arg->kmutex, RHINO_WAIT_FOREVER);
+            (*p_arg->counter)++;
+            krhino_mutex_unlock(p_arg->kmutex);
+        } else {
+            bench_pmutex_lock(p_arg->pmutex);
+            (*p_arg->counter)++;
+            bench_pmutex_unlock(p_arg->pmutex);
+        }
     }
 
-    mutex->owner = pthread_self();
-    mutex->lock_count++;
-    
-    printf("Thread %lu locked mutex '%s' (count: %d)\n", 
-           (unsigned long)pthread_self(), mutex->name, mutex->lock_count);
-    return RHINO_SUCCESS;
+    return NULL;
 }
 
-// Unlock mutex
-int krhino_mutex_unlock(kmutex_t *mutex) {
-    if (mutex == NULL) {
-        return RHINO_NULL_PTR;
+static double bench_mutex_run(kmutex_t *kmutex, bench_pmutex_t *pmutex, int nthreads) {
+    pthread_t threads[64];
+    bench_mutex_arg_t args[64];
+    volatile long counter = 0;
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i].kmutex = kmutex;
+        args[i].pmutex = pmutex;
+        args[i].ops = BENCH_MUTEX_OPS / nthreads;
+        args[i].counter = &counter;
+        pthread_create(&threads[i], NULL, bench_mutex_thread, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
     }
 
-    if (mutex->owner != pthread_self()) {
-        return RHINO_MUTEX_NOT_OWNER;
+    return (double)(BENCH_MUTEX_OPS / nthreads) * nthreads * 1000.0 / (bench_now_ns() - start);
+}
+
+// Lock/increment/unlock throughput, futex kmutex vs the pthread wrapper
+void bench_mutex(void) {
+    static const int threads[] = {1, 2, 4, 8, 16, 32, 64};
+    bench_pmutex_t pmutex;
+    kmutex_t kmutex;
+
+    krhino_mutex_create(&kmutex, "bench_mutex");
+    bench_pmutex_create(&pmutex);
+
+    printf("\nBenchmark: lock throughput (%d lock/unlock pairs, %ld CPUs)\n",
+           BENCH_MUTEX_OPS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %14s %14s\n", "threads", "kmutex Mops/s", "pthread Mops/s");
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        double native = bench_mutex_run(&kmutex, NULL, threads[t]);
+        double wrapper = bench_mutex_run(NULL, &pmutex, threads[t]);
+
+        printf("%-8d %14.2f %14.2f\n", threads[t], native, wrapper);
     }
+    pthread_mutex_destroy(&pmutex.mutex);
+    krhino_mutex_del(&kmutex);
+}
 
-    mutex->lock_count--;
-    printf("Thread %lu unlocked mutex '%s' (count: %d)\n", 
-           (unsigned long)pthread_self(), mutex->name, mutex->lock_count);
+#define BENCH_RW_OPS            2000000
+#define BENCH_RW_TABLE          64
 
-    if (mutex->lock_count == 0) {
-        mutex->owner = 0;
+typedef struct {
+    krwlock_t *rwlock;
+    kmutex_t *mutex;
+    int write_pct;
+    long ops;
+    int *table;
+} bench_rw_arg_t;
+
+static void *bench_rw_thread(void *arg) {
+    bench_rw_arg_t *p_arg = arg;
+    uint64_t seed = (uintptr_t)p_arg * 0x9e3779b97f4a7c15ull | 1;
+    volatile int sum = 0;
+
+    for (long i = 0; i < p_arg->ops; i++) {
+        int write;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        write = (int)(seed % 100) < p_arg->write_pct;
+
+        if (p_arg->rwlock) {
+            write ? krhino_rwlock_wrlock(p_arg->rwlock) : krhino_rwlock_rdlock(p_arg->rwlock);
+        } else {
+            krhino_mutex_lock(p_arg->mutex, RHINO_WAIT_FOREVER);
+        }
+        if (write) {
+            p_arg->table[seed % BENCH_RW_TABLE]++;
+        } else {
+            for (int j = 0; j < BENCH_RW_TABLE; j += 8) {
+                sum += p_arg->table[j];
+            }
+        }
+        if (p_arg->rwlock) {
+            krhino_rwlock_unlock(p_arg->rwlock);
+        } else {
+            krhino_mutex_unlock(p_arg->mutex);
+        }
     }
 
-    return pthread_mutex_unlock(&mutex->mutex);
+    return NULL;
 }
 
-// Delete mutex
-int krhino_mutex_del(kmutex_t *mutex) {
-    if (mutex == NULL) {
-        return RHINO_NULL_PTR;
+static double bench_rw_run(krwlock_t *rwlock, kmutex_t *mutex, int write_pct, int nthreads) {
+    static int table[BENCH_RW_TABLE];
+    pthread_t threads[64];
+    bench_rw_arg_t args[64];
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < nthreads; i++) {
+        args[i].rwlock = rwlock;
+        args[i].mutex = mutex;
+        args[i].write_pct = write_pct;
+        args[i].ops = BENCH_RW_OPS / nthreads;
+        args[i].table = table;
+        pthread_create(&threads[i], NULL, bench_rw_thread, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
     }
 
-    printf("Deleting mutex '%s'\n", mutex->name);
-    return pthread_mutex_destroy(&mutex->mutex);
+    return (double)(BENCH_RW_OPS / nthreads) * nthreads * 1000.0 / (bench_now_ns() - start);
 }
 
-// Shared resource
-int shared_counter = 0;
+// Read-mostly table, krwlock vs kmutex at 90/10 and 99/1 read/write
+void bench_rwlock(void) {
+    static const int threads[] = {1, 2, 4, 8, 16, 32, 64};
+    krwlock_t rwlock;
+    kmutex_t kmutex;
 
-// Test function for threads
-void* test_thread(void* arg) {
-    kmutex_t* mutex = (kmutex_t*)arg;
-    int i;
-    
-    for (i = 0; i < 3; i++) {
-        // Lock mutex
-        if (krhino_mutex_lock(mutex) != RHINO_SUCCESS) {
-            printf("Thread %lu failed to lock mutex\n", (unsigned long)pthread_self());
-            continue;
-        }
+    krhino_rwlock_create(&rwlock, "bench_rwlock");
+    krhino_mutex_create(&kmutex, "bench_mutex");
 
-        // Access shared resource
-        shared_counter++;
-        printf("Thread %lu: counter = %d\n", (unsigned long)pthread_self(), shared_counter);
-        
-        // Simulate some work
-        usleep(100000);  // 100ms
+    printf("\nBenchmark: read-mostly table (%d ops, %ld CPUs), Mops/s\n",
+           BENCH_RW_OPS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %12s %12s %12s %12s\n", "threads", "rw 90/10", "mutex 90/10", "rw 99/1", "mutex 99/1");
 
-        // Test recursive locking
-        if (i == 1) {  // On second iteration
-            printf("Thread %lu testing recursive lock\n", (unsigned long)pthread_self());
-            krhino_mutex_lock(mutex);
-            shared_counter++;
-            printf("Thread %lu: counter = %d (recursive)\n", 
-                   (unsigned long)pthread_self(), shared_counter);
-            krhino_mutex_unlock(mutex);
-        }
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        printf("%-8d %12.2f %12.2f %12.2f %12.2f\n", threads[t],
+               bench_rw_run(&rwlock, NULL, 10, threads[t]), bench_rw_run(NULL, &kmutex, 10, threads[t]),
+               bench_rw_run(&rwlock, NULL, 1, threads[t]), bench_rw_run(NULL, &kmutex, 1, threads[t]));
+    }
+    krhino_mutex_del(&kmutex);
+    krhino_rwlock_del(&rwlock);
+}
 
-        // Unlock mutex
-        krhino_mutex_unlock(mutex);
-        
-        // Small delay between iterations
-        usleep(50000);  // 50ms
+#define BENCH_LAT_OPS           400000
+#define BENCH_LAT_HOLD          50      // Loop iterations inside the lock
+
+typedef struct {
+    kmutex_t *mutex;
+    long ops;
+    uint64_t *lat;
+} bench_lat_arg_t;
+
+static void *bench_lat_thread(void *arg) {
+    bench_lat_arg_t *p_arg = arg;
+    volatile int work = 0;
+    uint64_t start;
+
+    for (long i = 0; i < p_arg->ops; i++) {
+        start = bench_now_ns();
+        krhino_mutex_lock(p_arg->mutex, RHINO_WAIT_FOREVER);
+        p_arg->lat[i] = bench_now_ns() - start;
+        for (int j = 0; j < BENCH_LAT_HOLD; j++) {
+            work++;
+        }
+        krhino_mutex_unlock(p_arg->mutex);
     }
 
     return NULL;
 }
 
-int main() {
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Acquire latency percentiles, barging (normal) vs FIFO handoff (fair)
+void bench_mutex_latency(void) {
+    static const int threads[] = {2, 4, 8, 16};
+    static const int types[] = {KMUTEX_TYPE_NORMAL, KMUTEX_TYPE_FAIR};
+    uint64_t *lat = malloc(BENCH_LAT_OPS * sizeof(uint64_t));
+    bench_lat_arg_t args[16];
+    pthread_t tids[16];
+    kmutex_t mutexes[2];
+
+    if (lat == NULL) {
+        printf("\nBenchmark: acquire latency skipped (out of memory)\n");
+        return;
+    }
+
+    // One mutex per mode, created ahead of the table: every run leaves it
+    // unlocked with no waiters queued
+    for (size_t m = 0; m < sizeof(types) / sizeof(types[0]); m++) {
+        test_mutex_create(&mutexes[m], "latency_mutex", types[m]);
+    }
+
+    printf("\nBenchmark: acquire latency (%d acquires, %ld CPUs)\n",
+           BENCH_LAT_OPS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %-7s %10s %10s %10s %12s %10s\n", "threads", "mode", "p50 ns", "p99 ns",
+           "p999 ns", "max ns", "Mops/s");
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        for (size_t m = 0; m < sizeof(types) / sizeof(types[0]); m++) {
+            long per = BENCH_LAT_OPS / threads[t];
+            long total = per * threads[t];
+            uint64_t start, elapsed;
+
+            start = bench_now_ns();
+            for (int i = 0; i < threads[t]; i++) {
+                args[i].mutex = &mutexes[m];
+                args[i].ops = per;
+                args[i].lat = lat + i * per;
+                pthread_create(&tids[i], NULL, bench_lat_thread, &args[i]);
+            }
+            for (int i = 0; i < threads[t]; i++) {
+                pthread_join(tids[i], NULL);
+            }
+            elapsed = bench_now_ns() - start;
+
+            qsort(lat, total, sizeof(uint64_t), bench_cmp_u64);
+            printf("%-8d %-7s %10llu %10llu %10llu %12llu %10.2f\n", threads[t],
+                   types[m] == KMUTEX_TYPE_FAIR ? "fair" : "normal",
+                   (unsigned long long)lat[total / 2], (unsigned long long)lat[total / 100 * 99],
+                   (unsigned long long)lat[total / 1000 * 999], (unsigned long long)lat[total - 1],
+                   total * 1000.0 / elapsed);
+        }
+    }
+
+    for (size_t m = 0; m < sizeof(types) / sizeof(types[0]); m++) {
+        krhino_mutex_del(&mutexes[m]);
+    }
+    free(lat);
+}
+
+int main(int argc, char *argv[]) {
     kmutex_t mutex;
     pthread_t threads[3];
     int i;
@@ -169,5 +1969,23 @@ int main() {
     printf("\nFinal counter value: %d\n", shared_counter);
     printf("Test completed successfully!\n");
 
+    test_mutex_stress(KMUTEX_TYPE_NORMAL);
+    test_mutex_stress(KMUTEX_TYPE_PI);
+    test_mutex_stress(KMUTEX_TYPE_FAIR);
+    test_mutex_pi();
+    test_mutex_pi_dead_owner();
+    test_rwlock();
+    test_mutex_timed();
+#ifdef KMUTEX_PROFILE
+    test_mutex_profile();
+#endif
+
+    // Benchmarks only run on request: ./mutex_test bench
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench_mutex();
+        bench_rwlock();
+        bench_mutex_latency();
+    }
+
     return 0;
 }
@@ -1,32 +1,96 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 // Simplified definitions
 typedef char * name_t;
-typedef unsigned int size_t;
-typedef unsigned char uint8_t;
 typedef int kstat_t;
 
 #define RHINO_SUCCESS 0
 #define RHINO_INV_PARAM -1
+#define RHINO_TIMEOUT   -2
+
+// Timeouts for queue_send/queue_receive, in milliseconds otherwise
+#define RHINO_NO_WAIT       0
+#define RHINO_WAIT_FOREVER  -1
 #define NULL_PARA_CHK(para) if (para == NULL) return RHINO_INV_PARAM
 
-// Simple ring buffer implementation
+#define RING_IS_POW2(n) (((n) & ((n) - 1)) == 0)
+
+#define QUEUE_CACHE_LINE    64
+#define QUEUE_STAT_SAMPLE   64      // MPMC cur_num refresh period, power of two
+
+// Queue backends
+#define QUEUE_TYPE_RING     0       // ring_buffer_t under the queue lock
+#define QUEUE_TYPE_MPMC     1       // Lock-free mpmc_ring_t
+#define QUEUE_TYPE_BUF      2       // Messages stored by value in ring slots
+#define QUEUE_TYPE_PRIO     3       // One ring_buffer_t per priority level
+
+#define QUEUE_PRIO_MAX      32      // Levels in a priority queue, one bitmap bit each
+
+#define QUEUE_INLINE_MAX    64      // Largest by-value message
+
+// Slot stride for by-value messages of msg_size bytes
+#define QUEUE_SLOT_SIZE(msg_size) \
+    (((msg_size) + QUEUE_CACHE_LINE - 1) & ~(size_t)(QUEUE_CACHE_LINE - 1))
+
+// Simple ring buffer implementation. When size is a power of two, head and
+// tail are free-running counters masked on access and the fill level is
+// tail - head, so count is not maintained and no divide is needed.
 typedef struct {
     void **buffer;
     size_t size;
     size_t head;
     size_t tail;
     size_t count;
+    size_t mask;    // size - 1 for power-of-two sizes, 0 selects modulo indexing
+    uint8_t *slots; // By-value storage, QUEUE_SLOT_SIZE(msg_size) per message
+    size_t msg_size;
 } ring_buffer_t;
 
+typedef struct {
+    size_t seq;     // Turn number: pos for producers, pos + 1 for consumers
+    void *msg;
+} kqueue_cell_t;
+
+// Producer and consumer positions live on their own cache lines
+typedef struct {
+    kqueue_cell_t *cells;
+    size_t mask;
+    size_t enqueue_pos __attribute__((aligned(QUEUE_CACHE_LINE)));
+    size_t dequeue_pos __attribute__((aligned(QUEUE_CACHE_LINE)));
+    uint8_t pad[QUEUE_CACHE_LINE - sizeof(size_t)];
+} mpmc_ring_t;
+
+// One level of a priority queue, 0 is the most urgent
+typedef struct {
+    ring_buffer_t ring;
+    size_t peak_num;
+    pthread_cond_t not_full;    // Senders blocked on this level being full
+    size_t send_waiters;
+} kqueue_level_t;
+
 typedef struct {
     ring_buffer_t ring_buf;
     size_t size;
     size_t cur_num;
     size_t peak_num;
     name_t name;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;    // Senders blocked on a full queue
+    pthread_cond_t not_empty;   // Receivers blocked on an empty queue
+    size_t send_waiters;
+    size_t recv_waiters;
+    uint8_t type;               // QUEUE_TYPE_*
+    uint8_t level_num;          // QUEUE_TYPE_PRIO levels
+    uint32_t level_map;         // Bit n set while level n is not empty
+    kqueue_level_t *levels;
+    mpmc_ring_t mpmc;
 } kqueue_t;
 
 // Ring buffer functions
@@ -36,9 +100,24 @@ void ring_buffer_init(ring_buffer_t *rb, void **buffer, size_t size) {
     rb->head = 0;
     rb->tail = 0;
     rb->count = 0;
+    rb->mask = (size > 1 && RING_IS_POW2(size)) ? size - 1 : 0;
+    rb->slots = NULL;
+    rb->msg_size = 0;
+}
+
+size_t ring_buffer_count(ring_buffer_t *rb) {
+    return rb->mask ? rb->tail - rb->head : rb->count;
 }
 
 int ring_buffer_push(ring_buffer_t *rb, void *item) {
+    if (rb->mask) {
+        if (rb->tail - rb->head == rb->size) {
+            return -1;  // Buffer full
+        }
+        rb->buffer[rb->tail++ & rb->mask] = item;
+        return 0;
+    }
+
     if (rb->count == rb->size) {
         return -1;  // Buffer full
     }
@@ -48,7 +127,77 @@ int ring_buffer_push(ring_buffer_t *rb, void *item) {
     return 0;
 }
 
+// Insert at the head so the item is popped next
+int ring_buffer_push_front(ring_buffer_t *rb, void *item) {
+    if (rb->mask) {
+        if (rb->tail - rb->head == rb->size) {
+            return -1;  // Buffer full
+        }
+        rb->buffer[--rb->head & rb->mask] = item;
+        return 0;
+    }
+
+    if (rb->count == rb->size) {
+        return -1;  // Buffer full
+    }
+    rb->head = (rb->head + rb->size - 1) % rb->size;
+    rb->buffer[rb->head] = item;
+    rb->count++;
+    return 0;
+}
+
+// By-value variants: the message is copied into and out of its slot
+int ring_buffer_push_copy(ring_buffer_t *rb, const void *msg) {
+    size_t idx;
+
+    if (rb->mask) {
+        if (rb->tail - rb->head == rb->size) {
+            return -1;  // Buffer full
+        }
+        idx = rb->tail++ & rb->mask;
+    } else {
+        if (rb->count == rb->size) {
+            return -1;  // Buffer full
+        }
+        idx = rb->tail;
+        rb->tail = (rb->tail + 1) % rb->size;
+        rb->count++;
+    }
+
+    memcpy(rb->slots + idx * QUEUE_SLOT_SIZE(rb->msg_size), msg, rb->msg_size);
+    return 0;
+}
+
+int ring_buffer_pop_copy(ring_buffer_t *rb, void *msg) {
+    size_t idx;
+
+    if (rb->mask) {
+        if (rb->tail == rb->head) {
+            return -1;  // Buffer empty
+        }
+        idx = rb->head++ & rb->mask;
+    } else {
+        if (rb->count == 0) {
+            return -1;  // Buffer empty
+        }
+        idx = rb->head;
+        rb->head = (rb->head + 1) % rb->size;
+        rb->count--;
+    }
+
+    memcpy(msg, rb->slots + idx * QUEUE_SLOT_SIZE(rb->msg_size), rb->msg_size);
+    return 0;
+}
+
 int ring_buffer_pop(ring_buffer_t *rb, void **item) {
+    if (rb->mask) {
+        if (rb->tail == rb->head) {
+            return -1;  // Buffer empty
+        }
+        *item = rb->buffer[rb->head++ & rb->mask];
+        return 0;
+    }
+
     if (rb->count == 0) {
         return -1;  // Buffer empty
     }
@@ -58,7 +207,127 @@ int ring_buffer_pop(ring_buffer_t *rb, void **item) {
     return 0;
 }
 
+// Bounded MPMC ring (Vyukov): every cell carries a sequence number that
+// tells producers and consumers whose turn it is, so each side only
+// contends on its own position counter and never takes a lock
+int mpmc_ring_push(mpmc_ring_t *rb, void *item) {
+    kqueue_cell_t *cell;
+    size_t pos = __atomic_load_n(&rb->enqueue_pos, __ATOMIC_RELAXED);
+    size_t seq;
+    intptr_t dif;
+
+    for (;;) {
+        cell = &rb->cells[pos & rb->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&rb->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return -1;  // Buffer full
+        } else {
+            pos = __atomic_load_n(&rb->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->msg = item;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int mpmc_ring_pop(mpmc_ring_t *rb, void **item) {
+    kqueue_cell_t *cell;
+    size_t pos = __atomic_load_n(&rb->dequeue_pos, __ATOMIC_RELAXED);
+    size_t seq;
+    intptr_t dif;
+
+    for (;;) {
+        cell = &rb->cells[pos & rb->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&rb->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return -1;  // Buffer empty
+        } else {
+            pos = __atomic_load_n(&rb->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    *item = cell->msg;
+    __atomic_store_n(&cell->seq, pos + rb->mask + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Approximate fill level, the two positions are read at different times
+size_t mpmc_ring_count(mpmc_ring_t *rb) {
+    size_t deq = __atomic_load_n(&rb->dequeue_pos, __ATOMIC_RELAXED);
+    size_t enq = __atomic_load_n(&rb->enqueue_pos, __ATOMIC_RELAXED);
+
+    return (enq > deq) ? enq - deq : 0;
+}
+
 // Queue functions
+
+// Smallest power of two >= msg_num: sizing the buffer to this lets
+// queue_create use the masked ring
+size_t queue_pow2_size(size_t msg_num) {
+    size_t size = 1;
+
+    while (size < msg_num) {
+        size <<= 1;
+    }
+    return size;
+}
+
+// Lock and condition variables, timed waits use the monotonic clock.
+// Each priority level gets its own not_full.
+static void queue_sync_init(kqueue_t *queue) {
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->not_full, &attr);
+    pthread_cond_init(&queue->not_empty, &attr);
+    for (uint8_t i = 0; i < queue->level_num; i++) {
+        pthread_cond_init(&queue->levels[i].not_full, &attr);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+static void queue_deadline(struct timespec *ts, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Park on one condition; only the side that changes it signals, one
+// waiter at a time, and only when someone is counted as waiting
+static int queue_wait(kqueue_t *queue, pthread_cond_t *cond, size_t *waiters,
+                      int timeout_ms, const struct timespec *ts) {
+    int ret;
+
+    (*waiters)++;
+    if (timeout_ms < 0) {
+        ret = pthread_cond_wait(cond, &queue->lock);
+    } else {
+        ret = pthread_cond_timedwait(cond, &queue->lock, ts);
+    }
+    (*waiters)--;
+
+    return ret;
+}
+
 kstat_t queue_create(kqueue_t *queue, const name_t name, void **buffer, size_t msg_num) {
     NULL_PARA_CHK(queue);
     NULL_PARA_CHK(buffer);
@@ -72,36 +341,997 @@ kstat_t queue_create(kqueue_t *queue, const name_t name, void **buffer, size_t m
     ring_buffer_init(&queue->ring_buf, buffer, msg_num);
     queue->size = msg_num;
     queue->name = name;
+    queue_sync_init(queue);
     return RHINO_SUCCESS;
 }
 
-kstat_t queue_send(kqueue_t *queue, void *msg) {
+// Create a queue on the lock-free MPMC ring. msg_num must be a power of
+// two; cells must hold msg_num entries.
+kstat_t queue_create_mpmc(kqueue_t *queue, const name_t name, kqueue_cell_t *cells, size_t msg_num) {
     NULL_PARA_CHK(queue);
-    
-    if (ring_buffer_push(&queue->ring_buf, msg) != 0) {
-        return RHINO_INV_PARAM;  // Queue full
+    NULL_PARA_CHK(cells);
+    NULL_PARA_CHK(name);
+
+    if (msg_num < 2 || !RING_IS_POW2(msg_num)) {
+        return RHINO_INV_PARAM;
     }
-    
-    queue->cur_num = queue->ring_buf.count;
-    if (queue->cur_num > queue->peak_num) {
-        queue->peak_num = queue->cur_num;
+
+    memset(queue, 0, sizeof(kqueue_t));
+    for (size_t i = 0; i < msg_num; i++) {
+        cells[i].seq = i;
     }
+    queue->mpmc.cells = cells;
+    queue->mpmc.mask = msg_num - 1;
+    queue->type = QUEUE_TYPE_MPMC;
+    queue->size = msg_num;
+    queue->name = name;
+    queue_sync_init(queue);
     return RHINO_SUCCESS;
 }
 
-kstat_t queue_receive(kqueue_t *queue, void **msg) {
+// Create a queue that stores messages of msg_size bytes by value. slots
+// must be QUEUE_CACHE_LINE aligned and hold msg_num * QUEUE_SLOT_SIZE(msg_size)
+// bytes; msg_size is at most QUEUE_INLINE_MAX.
+kstat_t queue_buf_create(kqueue_t *queue, const name_t name, void *slots, size_t msg_size, size_t msg_num) {
     NULL_PARA_CHK(queue);
-    NULL_PARA_CHK(msg);
-    
-    if (ring_buffer_pop(&queue->ring_buf, msg) != 0) {
-        return RHINO_INV_PARAM;  // Queue empty
+    NULL_PARA_CHK(slots);
+    NULL_PARA_CHK(name);
+
+    if (msg_size == 0 || msg_size > QUEUE_INLINE_MAX || msg_num == 0 ||
+        ((uintptr_t)slots & (QUEUE_CACHE_LINE - 1)) != 0) {
+        return RHINO_INV_PARAM;
     }
-    
-    queue->cur_num = queue->ring_buf.count;
+
+    memset(queue, 0, sizeof(kqueue_t));
+    ring_buffer_init(&queue->ring_buf, NULL, msg_num);
+    queue->ring_buf.slots = slots;
+    queue->ring_buf.msg_size = msg_size;
+    queue->type = QUEUE_TYPE_BUF;
+    queue->size = msg_num;
+    queue->name = name;
+    queue_sync_init(queue);
     return RHINO_SUCCESS;
 }
 
-int main() {
+// Create a queue with level_num priorities, each holding up to msg_num
+// messages: buffer must hold level_num * msg_num pointers and levels
+// level_num entries. Receivers always take the most urgent (lowest)
+// non-empty level, FIFO within a level.
+kstat_t queue_create_prio(kqueue_t *queue, const name_t name, kqueue_level_t *levels,
+                          uint8_t level_num, void **buffer, size_t msg_num) {
+    NULL_PARA_CHK(queue);
+    NULL_PARA_CHK(levels);
+    NULL_PARA_CHK(buffer);
+    NULL_PARA_CHK(name);
+
+    if (msg_num == 0 || level_num == 0 || level_num > QUEUE_PRIO_MAX) {
+        return RHINO_INV_PARAM;
+    }
+
+    memset(queue, 0, sizeof(kqueue_t));
+    for (uint8_t i = 0; i < level_num; i++) {
+        ring_buffer_init(&levels[i].ring, buffer + i * msg_num, msg_num);
+        levels[i].peak_num = 0;
+        levels[i].send_waiters = 0;
+    }
+    queue->levels = levels;
+    queue->level_num = level_num;
+    queue->type = QUEUE_TYPE_PRIO;
+    queue->size = level_num * msg_num;
+    queue->name = name;
+    queue_sync_init(queue);
+    return RHINO_SUCCESS;
+}
+
+// Statistics without a shared lock: peak_num is raised with a CAS, which
+// is rare once the peak settles; cur_num is refreshed every
+// QUEUE_STAT_SAMPLE operations so it does not bounce between cores
+static void queue_mpmc_stat(kqueue_t *queue, size_t pos) {
+    size_t cur = mpmc_ring_count(&queue->mpmc);
+    size_t peak = __atomic_load_n(&queue->peak_num, __ATOMIC_RELAXED);
+
+    while (cur > peak) {
+        if (__atomic_compare_exchange_n(&queue->peak_num, &peak, cur, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if ((pos & (QUEUE_STAT_SAMPLE - 1)) == 0) {
+        __atomic_store_n(&queue->cur_num, cur, __ATOMIC_RELAXED);
+    }
+}
+
+// Wake one waiter on cond if any is parked. The fence orders the ring
+// update before the waiter check, pairing with the fence in
+// queue_mpmc_wait, so either we see the waiter or it sees our update.
+static void queue_mpmc_wake(kqueue_t *queue, pthread_cond_t *cond, size_t *waiters) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+// Slow path: register as a waiter, then retry the operation under the
+// lock before each park so a wakeup cannot slip in between
+static kstat_t queue_mpmc_wait(kqueue_t *queue, pthread_cond_t *cond, size_t *waiters,
+                               int timeout_ms, void *msg, void **pmsg) {
+    struct timespec ts;
+    kstat_t ret = RHINO_SUCCESS;
+    int wait_ret = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if (timeout_ms > 0) {
+        queue_deadline(&ts, timeout_ms);
+    }
+
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while ((pmsg ? mpmc_ring_pop(&queue->mpmc, pmsg) : mpmc_ring_push(&queue->mpmc, msg)) != 0) {
+        if (wait_ret == ETIMEDOUT) {
+            ret = RHINO_TIMEOUT;
+            break;
+        }
+        if (timeout_ms < 0) {
+            wait_ret = pthread_cond_wait(cond, &queue->lock);
+        } else {
+            wait_ret = pthread_cond_timedwait(cond, &queue->lock, &ts);
+        }
+    }
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+static kstat_t queue_mpmc_send(kqueue_t *queue, void *msg, int timeout_ms) {
+    kstat_t ret;
+
+    if (mpmc_ring_push(&queue->mpmc, msg) != 0) {
+        if (timeout_ms == RHINO_NO_WAIT) {
+            return RHINO_INV_PARAM;  // Queue full
+        }
+        ret = queue_mpmc_wait(queue, &queue->not_full, &queue->send_waiters, timeout_ms, msg, NULL);
+        if (ret != RHINO_SUCCESS) {
+            return ret;
+        }
+    }
+
+    queue_mpmc_stat(queue, __atomic_load_n(&queue->mpmc.enqueue_pos, __ATOMIC_RELAXED));
+    queue_mpmc_wake(queue, &queue->not_empty, &queue->recv_waiters);
+    return RHINO_SUCCESS;
+}
+
+static kstat_t queue_mpmc_receive(kqueue_t *queue, void **msg, int timeout_ms) {
+    kstat_t ret;
+
+    if (mpmc_ring_pop(&queue->mpmc, msg) != 0) {
+        if (timeout_ms == RHINO_NO_WAIT) {
+            return RHINO_INV_PARAM;  // Queue empty
+        }
+        ret = queue_mpmc_wait(queue, &queue->not_empty, &queue->recv_waiters, timeout_ms, NULL, msg);
+        if (ret != RHINO_SUCCESS) {
+            return ret;
+        }
+    }
+
+    if ((__atomic_load_n(&queue->mpmc.dequeue_pos, __ATOMIC_RELAXED) & (QUEUE_STAT_SAMPLE - 1)) == 0) {
+        __atomic_store_n(&queue->cur_num, mpmc_ring_count(&queue->mpmc), __ATOMIC_RELAXED);
+    }
+    queue_mpmc_wake(queue, &queue->not_full, &queue->send_waiters);
+    return RHINO_SUCCESS;
+}
+
+kstat_t queue_del(kqueue_t *queue) {
+    NULL_PARA_CHK(queue);
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    for (uint8_t i = 0; i < queue->level_num; i++) {
+        pthread_cond_destroy(&queue->levels[i].not_full);
+    }
+    return RHINO_SUCCESS;
+}
+
+// Ring storage for the locked queue types: by pointer, by value for
+// QUEUE_TYPE_BUF, or on level prio for QUEUE_TYPE_PRIO. Called with
+// queue->lock held.
+static int queue_put(kqueue_t *queue, void *msg, uint8_t prio, int front) {
+    kqueue_level_t *level;
+    size_t cnt;
+
+    if (queue->type == QUEUE_TYPE_BUF) {
+        return ring_buffer_push_copy(&queue->ring_buf, msg);
+    }
+
+    if (queue->type != QUEUE_TYPE_PRIO) {
+        return front ? ring_buffer_push_front(&queue->ring_buf, msg)
+                     : ring_buffer_push(&queue->ring_buf, msg);
+    }
+
+    level = &queue->levels[prio];
+    if ((front ? ring_buffer_push_front(&level->ring, msg) : ring_buffer_push(&level->ring, msg)) != 0) {
+        return -1;
+    }
+    queue->level_map |= 1u << prio;
+    cnt = ring_buffer_count(&level->ring);
+    if (cnt > level->peak_num) {
+        level->peak_num = cnt;
+    }
+    return 0;
+}
+
+// Returns the level a slot was freed on (0 for the single-ring types),
+// -1 when empty
+static int queue_get(kqueue_t *queue, void *msg) {
+    ring_buffer_t *rb;
+    int prio;
+
+    if (queue->type == QUEUE_TYPE_BUF) {
+        return ring_buffer_pop_copy(&queue->ring_buf, msg);
+    }
+
+    if (queue->type != QUEUE_TYPE_PRIO) {
+        return ring_buffer_pop(&queue->ring_buf, msg);
+    }
+
+    if (queue->level_map == 0) {
+        return -1;  // All levels empty
+    }
+    prio = __builtin_ctz(queue->level_map);
+    rb = &queue->levels[prio].ring;
+    ring_buffer_pop(rb, msg);
+    if (ring_buffer_count(rb) == 0) {
+        queue->level_map &= ~(1u << prio);
+    }
+    return prio;
+}
+
+static kstat_t queue_ring_send(kqueue_t *queue, void *msg, uint8_t prio, int front, int timeout_ms) {
+    struct timespec ts;
+    kstat_t ret = RHINO_SUCCESS;
+    int wait_ret = 0;
+    pthread_cond_t *not_full = &queue->not_full;
+    size_t *send_waiters = &queue->send_waiters;
+
+    // Priority senders only wait for their own level to drain
+    if (queue->type == QUEUE_TYPE_PRIO) {
+        not_full = &queue->levels[prio].not_full;
+        send_waiters = &queue->levels[prio].send_waiters;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    if (timeout_ms > 0) {
+        queue_deadline(&ts, timeout_ms);
+    }
+
+    // One more attempt after a timeout: the wakeup may have raced it
+    while (queue_put(queue, msg, prio, front) != 0) {
+        if (timeout_ms == RHINO_NO_WAIT || wait_ret == ETIMEDOUT) {
+            ret = (timeout_ms == RHINO_NO_WAIT) ? RHINO_INV_PARAM : RHINO_TIMEOUT;
+            break;
+        }
+        wait_ret = queue_wait(queue, not_full, send_waiters, timeout_ms, &ts);
+    }
+
+    if (ret == RHINO_SUCCESS) {
+        queue->cur_num++;
+        if (queue->cur_num > queue->peak_num) {
+            queue->peak_num = queue->cur_num;
+        }
+        if (queue->recv_waiters > 0) {
+            pthread_cond_signal(&queue->not_empty);
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+static kstat_t queue_ring_receive(kqueue_t *queue, void *msg, int timeout_ms) {
+    struct timespec ts;
+    kstat_t ret = RHINO_SUCCESS;
+    int wait_ret = 0;
+    kqueue_level_t *level;
+    int prio;
+
+    pthread_mutex_lock(&queue->lock);
+    if (timeout_ms > 0) {
+        queue_deadline(&ts, timeout_ms);
+    }
+
+    while ((prio = queue_get(queue, msg)) < 0) {
+        if (timeout_ms == RHINO_NO_WAIT || wait_ret == ETIMEDOUT) {
+            ret = (timeout_ms == RHINO_NO_WAIT) ? RHINO_INV_PARAM : RHINO_TIMEOUT;
+            break;
+        }
+        wait_ret = queue_wait(queue, &queue->not_empty, &queue->recv_waiters, timeout_ms, &ts);
+    }
+
+    if (ret == RHINO_SUCCESS) {
+        queue->cur_num--;
+        // Only the level that just freed a slot has a sender to wake
+        if (queue->type == QUEUE_TYPE_PRIO) {
+            level = &queue->levels[prio];
+            if (level->send_waiters > 0) {
+                pthread_cond_signal(&level->not_full);
+            }
+        } else if (queue->send_waiters > 0) {
+            pthread_cond_signal(&queue->not_full);
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+// Send a message. timeout_ms is RHINO_NO_WAIT to fail at once when the
+// queue is full (RHINO_INV_PARAM), RHINO_WAIT_FOREVER, or a bound in
+// milliseconds after which RHINO_TIMEOUT is returned. Priority queues
+// take it on their least urgent level.
+kstat_t queue_send(kqueue_t *queue, void *msg, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+
+    if (queue->type == QUEUE_TYPE_MPMC) {
+        return queue_mpmc_send(queue, msg, timeout_ms);
+    }
+
+    if (queue->type == QUEUE_TYPE_BUF) {
+        return RHINO_INV_PARAM;  // Use queue_buf_send
+    }
+
+    return queue_ring_send(queue, msg, queue->level_num ? queue->level_num - 1 : 0, 0, timeout_ms);
+}
+
+// Urgent send: the message is received before anything already queued
+// (on a priority queue, ahead of everything on level 0). Not supported
+// by the MPMC and by-value queues.
+kstat_t queue_send_front(kqueue_t *queue, void *msg, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+
+    if (queue->type == QUEUE_TYPE_MPMC || queue->type == QUEUE_TYPE_BUF) {
+        return RHINO_INV_PARAM;
+    }
+
+    return queue_ring_send(queue, msg, 0, 1, timeout_ms);
+}
+
+// Send on level prio of a priority queue, FIFO behind that level
+kstat_t queue_send_prio(kqueue_t *queue, void *msg, uint8_t prio, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+
+    if (queue->type != QUEUE_TYPE_PRIO || prio >= queue->level_num) {
+        return RHINO_INV_PARAM;
+    }
+
+    return queue_ring_send(queue, msg, prio, 0, timeout_ms);
+}
+
+// Receive a message, timeout_ms as for queue_send
+kstat_t queue_receive(kqueue_t *queue, void **msg, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+    NULL_PARA_CHK(msg);
+
+    if (queue->type == QUEUE_TYPE_MPMC) {
+        return queue_mpmc_receive(queue, msg, timeout_ms);
+    }
+
+    if (queue->type == QUEUE_TYPE_BUF) {
+        return RHINO_INV_PARAM;  // Use queue_buf_recv
+    }
+
+    return queue_ring_receive(queue, msg, timeout_ms);
+}
+
+// Send a message by value: msg_size bytes are copied from msg
+kstat_t queue_buf_send(kqueue_t *queue, const void *msg, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+    NULL_PARA_CHK(msg);
+
+    if (queue->type != QUEUE_TYPE_BUF) {
+        return RHINO_INV_PARAM;
+    }
+
+    return queue_ring_send(queue, (void *)msg, 0, 0, timeout_ms);
+}
+
+// Receive a message by value: msg_size bytes are copied to msg
+kstat_t queue_buf_recv(kqueue_t *queue, void *msg, int timeout_ms) {
+    NULL_PARA_CHK(queue);
+    NULL_PARA_CHK(msg);
+
+    if (queue->type != QUEUE_TYPE_BUF) {
+        return RHINO_INV_PARAM;
+    }
+
+    return queue_ring_receive(queue, msg, timeout_ms);
+}
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *blocking_sender(void *arg) {
+    kqueue_t *queue = arg;
+    static int data[4] = {10, 20, 30, 40};
+
+    for (int i = 0; i < 4; i++) {
+        usleep(20000);  // 20ms
+        queue_send(queue, &data[i], RHINO_WAIT_FOREVER);
+    }
+    return NULL;
+}
+
+// Blocking receive, timed receive and timed send on a full queue
+void test_blocking_queue(void) {
+    void *buffer[2];
+    kqueue_t queue;
+    pthread_t sender;
+    uint64_t start;
+    void *msg;
+    int data = 0;
+    kstat_t ret;
+
+    printf("\nTesting blocking send/receive...\n");
+    queue_create(&queue, "blocking_queue", buffer, 2);
+
+    start = bench_now_ns();
+    ret = queue_receive(&queue, &msg, 50);
+    printf("Receive on empty queue, 50ms timeout: %s after %llu ms\n",
+           ret == RHINO_TIMEOUT ? "RHINO_TIMEOUT" : "unexpected",
+           (unsigned long long)((bench_now_ns() - start) / 1000000));
+
+    pthread_create(&sender, NULL, blocking_sender, &queue);
+    for (int i = 0; i < 4; i++) {
+        if (queue_receive(&queue, &msg, RHINO_WAIT_FOREVER) == RHINO_SUCCESS) {
+            printf("Received message: %d\n", *(int *)msg);
+        }
+    }
+    pthread_join(sender, NULL);
+
+    queue_send(&queue, &data, RHINO_NO_WAIT);
+    queue_send(&queue, &data, RHINO_NO_WAIT);
+    start = bench_now_ns();
+    ret = queue_send(&queue, &data, 30);
+    printf("Send on full queue, 30ms timeout: %s after %llu ms\n",
+           ret == RHINO_TIMEOUT ? "RHINO_TIMEOUT" : "unexpected",
+           (unsigned long long)((bench_now_ns() - start) / 1000000));
+
+    queue_del(&queue);
+}
+
+static void *mpmc_sender(void *arg) {
+    kqueue_t *queue = arg;
+
+    for (uintptr_t i = 1; i <= 10000; i++) {
+        queue_send(queue, (void *)i, RHINO_WAIT_FOREVER);
+    }
+    return NULL;
+}
+
+static void *mpmc_receiver(void *arg) {
+    kqueue_t *queue = arg;
+    uintptr_t sum = 0;
+    void *msg;
+
+    for (int i = 0; i < 10000; i++) {
+        queue_receive(queue, &msg, RHINO_WAIT_FOREVER);
+        sum += (uintptr_t)msg;
+    }
+    return (void *)sum;
+}
+
+// Four senders and four receivers through an 8-slot MPMC queue, every
+// message must arrive exactly once
+void test_mpmc_queue(void) {
+    kqueue_cell_t cells[8];
+    kqueue_t queue;
+    pthread_t senders[4], receivers[4];
+    uintptr_t sum = 0;
+    void *ret;
+    void *msg;
+    int data = 7;
+
+    printf("\nTesting MPMC queue...\n");
+    queue_create_mpmc(&queue, "mpmc_queue", cells, 8);
+
+    for (int i = 0; i < 8; i++) {
+        queue_send(&queue, &data, RHINO_NO_WAIT);
+    }
+    printf("Send on full queue: %s\n",
+           queue_send(&queue, &data, RHINO_NO_WAIT) == RHINO_INV_PARAM ? "RHINO_INV_PARAM" : "unexpected");
+    while (queue_receive(&queue, &msg, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+    }
+    printf("Receive on empty queue, 20ms timeout: %s\n",
+           queue_receive(&queue, &msg, 20) == RHINO_TIMEOUT ? "RHINO_TIMEOUT" : "unexpected");
+
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&receivers[i], NULL, mpmc_receiver, &queue);
+        pthread_create(&senders[i], NULL, mpmc_sender, &queue);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(senders[i], NULL);
+        pthread_join(receivers[i], &ret);
+        sum += (uintptr_t)ret;
+    }
+    printf("4 x 4 threads: checksum %s, peak %zu of %zu\n",
+           sum == 4 * (10000ul * 10001 / 2) ? "ok" : "MISMATCH", queue.peak_num, queue.size);
+
+    queue_del(&queue);
+}
+
+// Wrap both ring flavours many times and check FIFO order and cur_num
+void test_pow2_queue(void) {
+    void *buffer[8];
+    kqueue_t queue;
+    size_t sizes[] = {5, 8};
+    void *msg;
+
+    printf("\nTesting modulo and power-of-two rings...\n");
+    for (int s = 0; s < 2; s++) {
+        size_t next_send = 0, next_recv = 0;
+        int errors = 0;
+
+        queue_create(&queue, "wrap_queue", buffer, sizes[s]);
+        for (int round = 0; round < 100; round++) {
+            while (queue_send(&queue, (void *)(uintptr_t)next_send, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+                next_send++;
+            }
+            if (queue.cur_num != sizes[s]) {
+                errors++;
+            }
+            for (int i = 0; i < 1 + round % 5; i++) {
+                if (queue_receive(&queue, &msg, RHINO_NO_WAIT) != RHINO_SUCCESS || (uintptr_t)msg != next_recv++) {
+                    errors++;
+                }
+            }
+        }
+        printf("size %zu (%s): %zu sent, peak %zu, %d errors\n", sizes[s],
+               queue.ring_buf.mask ? "masked" : "modulo", next_send, queue.peak_num, errors);
+        queue_del(&queue);
+    }
+}
+
+typedef struct {
+    uint32_t cmd;
+    uint32_t seq;
+    uint64_t arg[3];
+} test_cmd_t;
+
+// By-value messages: the receiver gets a copy, so the sender may reuse its
+// buffer at once, and the ring wraps in both indexing modes
+void test_buf_queue(void) {
+    static uint8_t slots[8 * QUEUE_SLOT_SIZE(sizeof(test_cmd_t))] __attribute__((aligned(QUEUE_CACHE_LINE)));
+    size_t sizes[] = {5, 8};
+    kqueue_t queue;
+    test_cmd_t cmd, out;
+    void *msg;
+
+    printf("\nTesting by-value queue (%zu-byte messages, %zu-byte slots)...\n",
+           sizeof(test_cmd_t), (size_t)QUEUE_SLOT_SIZE(sizeof(test_cmd_t)));
+    for (int s = 0; s < 2; s++) {
+        uint32_t next_send = 0, next_recv = 0;
+        int errors = 0;
+
+        queue_buf_create(&queue, "buf_queue", slots, sizeof(test_cmd_t), sizes[s]);
+        for (int round = 0; round < 100; round++) {
+            for (;;) {
+                cmd.cmd = 7;
+                cmd.seq = next_send;
+                cmd.arg[0] = cmd.arg[1] = cmd.arg[2] = next_send * 3ull;
+                if (queue_buf_send(&queue, &cmd, RHINO_NO_WAIT) != RHINO_SUCCESS) {
+                    break;
+                }
+                memset(&cmd, 0xff, sizeof(cmd));  // Sender reuses its buffer
+                next_send++;
+            }
+            for (int i = 0; i < 1 + round % 5; i++) {
+                if (queue_buf_recv(&queue, &out, RHINO_NO_WAIT) != RHINO_SUCCESS ||
+                    out.cmd != 7 || out.seq != next_recv || out.arg[2] != next_recv * 3ull) {
+                    errors++;
+                }
+                next_recv++;
+            }
+        }
+        printf("size %zu (%s): %u sent, peak %zu, %d errors\n", sizes[s],
+               queue.ring_buf.mask ? "masked" : "modulo", next_send, queue.peak_num, errors);
+        printf("Pointer API on by-value queue: %s\n",
+               queue_send(&queue, &cmd, RHINO_NO_WAIT) == RHINO_INV_PARAM &&
+               queue_receive(&queue, &msg, RHINO_NO_WAIT) == RHINO_INV_PARAM ? "rejected" : "unexpected");
+        queue_del(&queue);
+    }
+
+    printf("Misaligned slots: %s\n",
+           queue_buf_create(&queue, "buf_queue", slots + 8, sizeof(test_cmd_t), 4) == RHINO_INV_PARAM
+           ? "rejected" : "unexpected");
+    printf("Oversized message: %s\n",
+           queue_buf_create(&queue, "buf_queue", slots, QUEUE_INLINE_MAX + 1, 4) == RHINO_INV_PARAM
+           ? "rejected" : "unexpected");
+}
+
+// Front insertion on both ring layouts, then level ordering, per-level
+// peaks, a sender parked on a full level, and a receive only releasing
+// the sender of the level it drained
+static void *prio_sender(void *arg) {
+    kqueue_t *queue = arg;
+
+    queue_send_prio(queue, (void *)(uintptr_t)99, 3, RHINO_WAIT_FOREVER);
+    return NULL;
+}
+
+static int prio_level_sent[2];
+
+static void *prio_level_sender(void *arg) {
+    kqueue_t *queue = arg;
+    static int next;
+    uint8_t prio = (uint8_t)__atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % 2;
+
+    queue_send_prio(queue, (void *)(uintptr_t)(200 + prio), prio, RHINO_WAIT_FOREVER);
+    __atomic_store_n(&prio_level_sent[prio], 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_prio_queue(void) {
+    static void *buffer[4 * 4];
+    static kqueue_level_t levels[4];
+    static kqueue_cell_t cells[4];
+    static const uintptr_t expect[] = {100, 10, 11, 20, 30, 31, 32, 33, 99};
+    size_t sizes[] = {5, 8};
+    pthread_t sender, senders[2];
+    kqueue_t queue;
+    void *msg;
+    int errors;
+
+    printf("\nTesting urgent and priority sends...\n");
+    for (int s = 0; s < 2; s++) {
+        errors = 0;
+        queue_create(&queue, "front_queue", buffer, sizes[s]);
+        for (uintptr_t i = 0; i < 20; i++) {
+            // Two normal messages and one urgent: urgent comes out first
+            queue_send(&queue, (void *)(3 * i + 1), RHINO_NO_WAIT);
+            queue_send(&queue, (void *)(3 * i + 2), RHINO_NO_WAIT);
+            queue_send_front(&queue, (void *)(3 * i), RHINO_NO_WAIT);
+            for (uintptr_t j = 0; j < 3; j++) {
+                if (queue_receive(&queue, &msg, RHINO_NO_WAIT) != RHINO_SUCCESS || (uintptr_t)msg != 3 * i + j) {
+                    errors++;
+                }
+            }
+        }
+        printf("size %zu (%s): send_front order %s\n", sizes[s],
+               queue.ring_buf.mask ? "masked" : "modulo", errors ? "wrong" : "ok");
+        queue_del(&queue);
+    }
+
+    errors = 0;
+    queue_create_prio(&queue, "prio_queue", levels, 4, buffer, 4);
+    for (uintptr_t i = 30; i < 34; i++) {
+        queue_send(&queue, (void *)i, RHINO_NO_WAIT);  // Bulk, least urgent level
+    }
+    queue_send_prio(&queue, (void *)20, 2, RHINO_NO_WAIT);
+    queue_send_prio(&queue, (void *)10, 0, RHINO_NO_WAIT);
+    queue_send_prio(&queue, (void *)11, 0, RHINO_NO_WAIT);
+    queue_send_front(&queue, (void *)100, RHINO_NO_WAIT);
+    printf("Send on full level: %s, bad level: %s\n",
+           queue_send_prio(&queue, (void *)0, 3, RHINO_NO_WAIT) == RHINO_INV_PARAM ? "rejected" : "unexpected",
+           queue_send_prio(&queue, (void *)0, 4, RHINO_NO_WAIT) == RHINO_INV_PARAM ? "rejected" : "unexpected");
+
+    pthread_create(&sender, NULL, prio_sender, &queue);
+    usleep(20000);  // Let the sender block on level 3
+    for (size_t i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+        if (queue_receive(&queue, &msg, 1000) != RHINO_SUCCESS || (uintptr_t)msg != expect[i]) {
+            errors++;
+        }
+    }
+    pthread_join(sender, NULL);
+    printf("Priority order: %s, bitmap 0x%x, peak %zu, level peaks %zu %zu %zu %zu\n",
+           errors ? "wrong" : "ok", queue.level_map, queue.peak_num,
+           levels[0].peak_num, levels[1].peak_num, levels[2].peak_num, levels[3].peak_num);
+    queue_del(&queue);
+
+    // Both levels full, one sender parked on each
+    queue_create_prio(&queue, "level_queue", levels, 2, buffer, 1);
+    queue_send_prio(&queue, (void *)0, 0, RHINO_NO_WAIT);
+    queue_send_prio(&queue, (void *)1, 1, RHINO_NO_WAIT);
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&senders[i], NULL, prio_level_sender, &queue);
+    }
+    usleep(20000);
+    queue_receive(&queue, &msg, RHINO_NO_WAIT);  // Frees level 0 only
+    usleep(20000);
+    pthread_mutex_lock(&queue.lock);
+    errors = !__atomic_load_n(&prio_level_sent[0], __ATOMIC_ACQUIRE) ||
+             __atomic_load_n(&prio_level_sent[1], __ATOMIC_ACQUIRE) ||
+             levels[1].send_waiters != 1;
+    pthread_mutex_unlock(&queue.lock);
+    while (queue_receive(&queue, &msg, 1000) == RHINO_SUCCESS && (uintptr_t)msg != 201) {
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(senders[i], NULL);
+    }
+    printf("Per-level wakeup: %s\n", errors ? "wrong" : "ok");
+    queue_del(&queue);
+
+    queue_create_mpmc(&queue, "mpmc_queue", cells, 4);
+    printf("send_front on MPMC queue: %s\n",
+           queue_send_front(&queue, &msg, RHINO_NO_WAIT) == RHINO_INV_PARAM ? "rejected" : "unexpected");
+    queue_del(&queue);
+}
+
+#define BENCH_OPS 50000000
+
+// Per-op cost of the modulo ring vs the masked ring, sizes read at run time
+// so the compiler cannot turn the modulo into a multiply
+void bench_pow2_queue(void) {
+    static void *buffer[1024];
+    static volatile size_t sizes[] = {1000, 1024};
+    kqueue_t queue;
+    void *msg;
+
+    printf("\nBenchmark: modulo vs power-of-two ring (%d send+receive pairs)\n", BENCH_OPS);
+    printf("---------------------------------------------------------------\n");
+
+    for (int s = 0; s < 2; s++) {
+        uint64_t start, elapsed;
+
+        queue_create(&queue, "bench_queue", buffer, sizes[s]);
+        // Keep the queue half full so every op exercises the wrap
+        for (size_t i = 0; i < sizes[s] / 2; i++) {
+            queue_send(&queue, buffer, RHINO_NO_WAIT);
+        }
+
+        // The ring itself, queue_send/queue_receive add the lock on top
+        start = bench_now_ns();
+        for (int i = 0; i < BENCH_OPS; i++) {
+            ring_buffer_push(&queue.ring_buf, buffer);
+            ring_buffer_pop(&queue.ring_buf, &msg);
+        }
+        elapsed = bench_now_ns() - start;
+
+        printf("size %4zu (%s): %6.2f ns/op\n", sizes[s],
+               queue.ring_buf.mask ? "masked" : "modulo", (double)elapsed / (2.0 * BENCH_OPS));
+        queue_del(&queue);
+    }
+}
+
+#define BENCH_CONT_MSGS     400000
+#define BENCH_CONT_QUEUE    64
+
+typedef struct {
+    kqueue_t *queue;
+    size_t    count;     // Messages to send or receive
+    uint64_t *lat;       // Receive side: per-message latency in ns
+} bench_cont_arg_t;
+
+static void *bench_cont_producer(void *arg) {
+    bench_cont_arg_t *p_arg = arg;
+
+    // The message is its own send timestamp
+    for (size_t i = 0; i < p_arg->count; i++) {
+        queue_send(p_arg->queue, (void *)(uintptr_t)bench_now_ns(), RHINO_WAIT_FOREVER);
+    }
+    return NULL;
+}
+
+static void *bench_cont_consumer(void *arg) {
+    bench_cont_arg_t *p_arg = arg;
+    void *msg;
+
+    for (size_t i = 0; i < p_arg->count; i++) {
+        queue_receive(p_arg->queue, &msg, RHINO_WAIT_FOREVER);
+        p_arg->lat[i] = bench_now_ns() - (uint64_t)(uintptr_t)msg;
+    }
+    return NULL;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Run nprod producers and ncons consumers to completion, returns elapsed ns
+static uint64_t bench_cont_run(kqueue_t *queue, int nprod, int ncons, uint64_t *lat) {
+    pthread_t threads[64];
+    bench_cont_arg_t args[64];
+    uint64_t start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < ncons; i++) {
+        args[i].queue = queue;
+        args[i].count = BENCH_CONT_MSGS / ncons;
+        args[i].lat = lat + i * (BENCH_CONT_MSGS / ncons);
+        pthread_create(&threads[i], NULL, bench_cont_consumer, &args[i]);
+    }
+    for (int i = 0; i < nprod; i++) {
+        args[ncons + i].queue = queue;
+        args[ncons + i].count = BENCH_CONT_MSGS / nprod;
+        args[ncons + i].lat = NULL;
+        pthread_create(&threads[ncons + i], NULL, bench_cont_producer, &args[ncons + i]);
+    }
+    for (int i = 0; i < nprod + ncons; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return bench_now_ns() - start;
+}
+
+// N producers, M consumers on one blocking queue; send-to-receive latency
+void bench_blocking_queue(void) {
+    static void *buffer[BENCH_CONT_QUEUE];
+    static const int configs[][2] = {{1, 1}, {4, 1}, {1, 4}, {4, 4}, {16, 16}};
+    uint64_t *lat = malloc(BENCH_CONT_MSGS * sizeof(uint64_t));
+    kqueue_t queue;
+
+    printf("\nBenchmark: blocking queue under contention (%d msgs, depth %d)\n",
+           BENCH_CONT_MSGS, BENCH_CONT_QUEUE);
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %10s %10s %10s %10s %12s\n", "N x M", "p50 ns", "p99 ns", "p999 ns", "max ns", "Mmsg/s");
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        int nprod = configs[c][0], ncons = configs[c][1];
+        uint64_t elapsed;
+
+        queue_create(&queue, "bench_queue", buffer, BENCH_CONT_QUEUE);
+        elapsed = bench_cont_run(&queue, nprod, ncons, lat);
+
+        qsort(lat, BENCH_CONT_MSGS, sizeof(uint64_t), bench_cmp_u64);
+        printf("%2d x %-3d %10llu %10llu %10llu %10llu %12.2f\n", nprod, ncons,
+               (unsigned long long)lat[BENCH_CONT_MSGS / 2],
+               (unsigned long long)lat[BENCH_CONT_MSGS / 100 * 99],
+               (unsigned long long)lat[BENCH_CONT_MSGS / 1000 * 999],
+               (unsigned long long)lat[BENCH_CONT_MSGS - 1],
+               BENCH_CONT_MSGS * 1000.0 / elapsed);
+
+        queue_del(&queue);
+    }
+
+    free(lat);
+}
+
+// Locked ring vs lock-free MPMC ring, P producers and P consumers
+void bench_mpmc_queue(void) {
+    static void *buffer[BENCH_CONT_QUEUE];
+    static kqueue_cell_t cells[BENCH_CONT_QUEUE];
+    static const int threads[] = {1, 2, 4, 8, 16, 32};
+    uint64_t *lat = malloc(BENCH_CONT_MSGS * sizeof(uint64_t));
+    kqueue_t queue __attribute__((aligned(QUEUE_CACHE_LINE)));
+
+    printf("\nBenchmark: locked ring vs MPMC ring (%d msgs, depth %d, %ld cpus)\n",
+           BENCH_CONT_MSGS, BENCH_CONT_QUEUE, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %12s %12s %12s %12s\n", "P x P", "ring Mmsg/s", "ring p99", "mpmc Mmsg/s", "mpmc p99");
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        uint64_t ring_ns, mpmc_ns, ring_p99;
+
+        queue_create(&queue, "bench_ring", buffer, BENCH_CONT_QUEUE);
+        ring_ns = bench_cont_run(&queue, threads[t], threads[t], lat);
+        qsort(lat, BENCH_CONT_MSGS, sizeof(uint64_t), bench_cmp_u64);
+        ring_p99 = lat[BENCH_CONT_MSGS / 100 * 99];
+        queue_del(&queue);
+
+        queue_create_mpmc(&queue, "bench_mpmc", cells, BENCH_CONT_QUEUE);
+        mpmc_ns = bench_cont_run(&queue, threads[t], threads[t], lat);
+        qsort(lat, BENCH_CONT_MSGS, sizeof(uint64_t), bench_cmp_u64);
+        queue_del(&queue);
+
+        printf("%2d x %-3d %12.2f %12llu %12.2f %12llu\n", threads[t], threads[t],
+               BENCH_CONT_MSGS * 1000.0 / ring_ns, (unsigned long long)ring_p99,
+               BENCH_CONT_MSGS * 1000.0 / mpmc_ns, (unsigned long long)lat[BENCH_CONT_MSGS / 100 * 99]);
+    }
+
+    free(lat);
+}
+
+#define BENCH_BUF_MSGS      10000000
+
+// Small command messages: malloc'd payload passed by pointer (fill, send,
+// receive, read, free) vs the same payload copied through inline slots.
+// Messages go through in bursts of the queue depth so the reader touches
+// payloads written a while ago, as a consumer thread would.
+void bench_buf_queue(void) {
+    static void *buffer[BENCH_CONT_QUEUE];
+    static uint8_t slots[BENCH_CONT_QUEUE * QUEUE_SLOT_SIZE(sizeof(test_cmd_t))]
+        __attribute__((aligned(QUEUE_CACHE_LINE)));
+    kqueue_t queue;
+    test_cmd_t cmd, *pcmd;
+    uint64_t start, ptr_ns, buf_ns, sum = 0;
+    void *msg;
+
+    printf("\nBenchmark: pointer vs by-value messages (%d msgs, %zu bytes, depth %d)\n",
+           BENCH_BUF_MSGS, sizeof(test_cmd_t), BENCH_CONT_QUEUE);
+    printf("----------------------------------------------------------------\n");
+
+    queue_create(&queue, "bench_ptr", buffer, BENCH_CONT_QUEUE);
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_BUF_MSGS; i += BENCH_CONT_QUEUE) {
+        for (uint32_t j = 0; j < BENCH_CONT_QUEUE; j++) {
+            pcmd = malloc(sizeof(*pcmd));
+            pcmd->cmd = 1;
+            pcmd->seq = i + j;
+            pcmd->arg[0] = pcmd->arg[1] = pcmd->arg[2] = j;
+            queue_send(&queue, pcmd, RHINO_NO_WAIT);
+        }
+        while (queue_receive(&queue, &msg, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+            pcmd = msg;
+            sum += pcmd->seq + pcmd->arg[2];
+            free(pcmd);
+        }
+    }
+    ptr_ns = bench_now_ns() - start;
+    queue_del(&queue);
+
+    queue_buf_create(&queue, "bench_buf", slots, sizeof(test_cmd_t), BENCH_CONT_QUEUE);
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_BUF_MSGS; i += BENCH_CONT_QUEUE) {
+        for (uint32_t j = 0; j < BENCH_CONT_QUEUE; j++) {
+            cmd.cmd = 1;
+            cmd.seq = i + j;
+            cmd.arg[0] = cmd.arg[1] = cmd.arg[2] = j;
+            queue_buf_send(&queue, &cmd, RHINO_NO_WAIT);
+        }
+        while (queue_buf_recv(&queue, &cmd, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+            sum += cmd.seq + cmd.arg[2];
+        }
+    }
+    buf_ns = bench_now_ns() - start;
+    queue_del(&queue);
+
+    printf("malloc + pointer: %6.2f ns/msg\n", (double)ptr_ns / BENCH_BUF_MSGS);
+    printf("inline by value:  %6.2f ns/msg (%.2fx, checksum %llu)\n",
+           (double)buf_ns / BENCH_BUF_MSGS, (double)ptr_ns / buf_ns, (unsigned long long)sum);
+}
+
+#define BENCH_PRIO_OPS      20000000
+
+// Send + receive cost of a priority queue with its bitmap lookup against
+// the plain ring, messages spread over 1 and over all 32 levels
+void bench_prio_queue(void) {
+    static void *buffer[QUEUE_PRIO_MAX * BENCH_CONT_QUEUE];
+    static kqueue_level_t levels[QUEUE_PRIO_MAX];
+    static const int spread[] = {1, QUEUE_PRIO_MAX};
+    kqueue_t queue;
+    uint64_t start;
+    void *msg;
+
+    printf("\nBenchmark: priority queue (%d msgs, bursts of %d)\n", BENCH_PRIO_OPS, BENCH_CONT_QUEUE);
+    printf("----------------------------------------------------------------\n");
+
+    queue_create(&queue, "bench_fifo", buffer, BENCH_CONT_QUEUE);
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_PRIO_OPS; i += BENCH_CONT_QUEUE) {
+        for (int j = 0; j < BENCH_CONT_QUEUE; j++) {
+            queue_send(&queue, buffer, RHINO_NO_WAIT);
+        }
+        while (queue_receive(&queue, &msg, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+        }
+    }
+    printf("%-22s %6.2f ns/msg\n", "FIFO ring:", (double)(bench_now_ns() - start) / BENCH_PRIO_OPS);
+    queue_del(&queue);
+
+    for (size_t s = 0; s < sizeof(spread) / sizeof(spread[0]); s++) {
+        queue_create_prio(&queue, "bench_prio", levels, QUEUE_PRIO_MAX, buffer, BENCH_CONT_QUEUE);
+        start = bench_now_ns();
+        for (int i = 0; i < BENCH_PRIO_OPS; i += BENCH_CONT_QUEUE) {
+            for (int j = 0; j < BENCH_CONT_QUEUE; j++) {
+                queue_send_prio(&queue, buffer, (uint8_t)((j * 7) % spread[s]), RHINO_NO_WAIT);
+            }
+            while (queue_receive(&queue, &msg, RHINO_NO_WAIT) == RHINO_SUCCESS) {
+            }
+        }
+        printf("Priority, %2d level%s    %6.2f ns/msg\n", spread[s], spread[s] > 1 ? "s:" : ": ",
+               (double)(bench_now_ns() - start) / BENCH_PRIO_OPS);
+        queue_del(&queue);
+    }
+}
+
+int main(int argc, char *argv[]) {
     // Test the queue implementation
     const size_t QUEUE_SIZE = 5;
     void *buffer[QUEUE_SIZE];
@@ -117,23 +1347,40 @@ int main() {
     // Test sending messages
     printf("\nTesting message sending...\n");
     int data1 = 1, data2 = 2, data3 = 3;
-    if (queue_send(&queue, &data1) == RHINO_SUCCESS) {
+    if (queue_send(&queue, &data1, RHINO_NO_WAIT) == RHINO_SUCCESS) {
         printf("Sent message: %d\n", data1);
     }
-    if (queue_send(&queue, &data2) == RHINO_SUCCESS) {
+    if (queue_send(&queue, &data2, RHINO_NO_WAIT) == RHINO_SUCCESS) {
         printf("Sent message: %d\n", data2);
     }
-    if (queue_send(&queue, &data3) == RHINO_SUCCESS) {
+    if (queue_send(&queue, &data3, RHINO_NO_WAIT) == RHINO_SUCCESS) {
         printf("Sent message: %d\n", data3);
     }
     
     // Test receiving messages
     printf("\nTesting message receiving...\n");
     void *received_msg;
-    while (queue_receive(&queue, &received_msg) == RHINO_SUCCESS) {
+    while (queue_receive(&queue, &received_msg, RHINO_NO_WAIT) == RHINO_SUCCESS) {
         printf("Received message: %d\n", *(int*)received_msg);
     }
     
+    queue_del(&queue);
+
+    test_pow2_queue();
+    test_blocking_queue();
+    test_mpmc_queue();
+    test_buf_queue();
+    test_prio_queue();
+
+    // Benchmarks only run on request: ./queue_test bench
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench_pow2_queue();
+        bench_blocking_queue();
+        bench_mpmc_queue();
+        bench_buf_queue();
+        bench_prio_queue();
+    }
+    
     printf("\nQueue test completed!\n");
     return 0;
 }
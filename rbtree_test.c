@@ -1,5 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
 
 #define K_RBTREE_RED      0
 #define K_RBTREE_BLACK    1
@@ -8,13 +17,57 @@ struct k_rbtree_node_t {
     unsigned long rbt_parent_color;
     struct k_rbtree_node_t *rbt_left;
     struct k_rbtree_node_t *rbt_right;
-    int key;  // Added for testing purposes
 };
 
 struct k_rbtree_root_t {
     struct k_rbtree_node_t *rbt_node;
 };
 
+// Root with the leftmost (minimum) node cached for O(1) peek and pop
+struct k_rbtree_root_cached_t {
+    struct k_rbtree_root_t rbt_root;
+    struct k_rbtree_node_t *rbt_leftmost;
+};
+
+#define K_RBTREE_FIRST_CACHED(root) ((root)->rbt_leftmost)
+
+// Callbacks for augmented trees, where each node keeps a value derived
+// from its subtree (size, max interval end, ...)
+struct k_rbtree_augment_t {
+    // Recompute node, then its ancestors up to (not including) stop. May
+    // end early once a value comes out unchanged, but must not rely on the
+    // previous value of a freshly inserted node.
+    void (*propagate)(struct k_rbtree_node_t *node, struct k_rbtree_node_t *stop);
+    // new takes over old's position and subtree
+    void (*copy)(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new);
+    // Rotation: new has become the parent of old and now roots old's
+    // former subtree
+    void (*rotate)(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new);
+};
+
+// Root for read-mostly concurrent use. Writers serialize on lock and bump
+// seq around each change (odd while it is in progress). Readers search
+// without locking and retry a miss if seq moved; after
+// RBTREE_SEQ_RETRIES failed attempts they take the lock instead. Erased
+// entries must not be freed or re-keyed while readers may still be on
+// them.
+struct k_rbtree_seq_root_t {
+    struct k_rbtree_root_t rbt_root;
+    unsigned long seq;
+    pthread_mutex_t lock;
+};
+
+#define RBTREE_SEQ_RETRIES  2
+
+// Child pointers of linked nodes are written with single-copy-atomic
+// stores so lockless readers (see k_rbtree_seq_root_t) never see a torn
+// pointer, in an order that never forms a loop. A node becomes reachable
+// through K_RBTREE_PUBLISH, after its own fields are set. On common
+// targets all three are plain moves.
+#define K_RBTREE_WRITE_ONCE(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
+#define K_RBTREE_PUBLISH(x, val)    __atomic_store_n(&(x), (val), __ATOMIC_RELEASE)
+#define K_RBTREE_READ_ONCE(x)       __atomic_load_n(&(x), __ATOMIC_CONSUME)
+
 #define K_RBTREE_PARENT(r)    ((struct k_rbtree_node_t *)((r)->rbt_parent_color & ~3))
 #define K_RBTREE_COLOR(r)     ((r)->rbt_parent_color & 1)
 #define K_RBTREE_IS_RED(r)    (!K_RBTREE_COLOR(r))
@@ -50,11 +103,11 @@ static void rbtree_change_child(struct k_rbtree_node_t *old, struct k_rbtree_nod
 {
     if (parent) {
         if (parent->rbt_left == old)
-            parent->rbt_left = new;
+            K_RBTREE_PUBLISH(parent->rbt_left, new);
         else
-            parent->rbt_right = new;
+            K_RBTREE_PUBLISH(parent->rbt_right, new);
     } else
-        root->rbt_node = new;
+        K_RBTREE_PUBLISH(root->rbt_node, new);
 }
 
 static void rbtree_rotate_set_parents(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new,
@@ -66,7 +119,32 @@ static void rbtree_rotate_set_parents(struct k_rbtree_node_t *old, struct k_rbtr
     rbtree_change_child(old, new, parent, root);
 }
 
-void rbtree_insert_color(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root)
+// Plain trees pass these; with the fixups inlined they compile away
+static inline void rbtree_dummy_propagate(struct k_rbtree_node_t *node, struct k_rbtree_node_t *stop)
+{
+    (void)node;
+    (void)stop;
+}
+
+static inline void rbtree_dummy_copy(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new)
+{
+    (void)old;
+    (void)new;
+}
+
+static inline void rbtree_dummy_rotate(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new)
+{
+    (void)old;
+    (void)new;
+}
+
+static const struct k_rbtree_augment_t rbtree_dummy_augment = {
+    rbtree_dummy_propagate, rbtree_dummy_copy, rbtree_dummy_rotate
+};
+
+static inline __attribute__((always_inline)) void
+rbtree_insert_fixup(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root,
+                    void (*augment_rotate)(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new))
 {
     struct k_rbtree_node_t *parent = rbtree_parent(node), *gparent, *tmp;
 
@@ -94,20 +172,22 @@ void rbtree_insert_color(struct k_rbtree_node_t *node, struct k_rbtree_root_t *r
             tmp = parent->rbt_right;
             if (node == tmp) {
                 tmp = node->rbt_left;
-                parent->rbt_right = tmp;
-                node->rbt_left = parent;
+                K_RBTREE_WRITE_ONCE(parent->rbt_right, tmp);
+                K_RBTREE_WRITE_ONCE(node->rbt_left, parent);
                 if (tmp)
                     rbtree_set_parent_color(tmp, parent, K_RBTREE_BLACK);
                 rbtree_set_parent_color(parent, node, K_RBTREE_RED);
+                augment_rotate(parent, node);
                 parent = node;
                 tmp = node->rbt_right;
             }
 
-            gparent->rbt_left = tmp;
-            parent->rbt_right = gparent;
+            K_RBTREE_WRITE_ONCE(gparent->rbt_left, tmp);
+            K_RBTREE_WRITE_ONCE(parent->rbt_right, gparent);
             if (tmp)
                 rbtree_set_parent_color(tmp, gparent, K_RBTREE_BLACK);
             rbtree_rotate_set_parents(gparent, parent, root, K_RBTREE_RED);
+            augment_rotate(gparent, parent);
             break;
         } else {
             tmp = gparent->rbt_left;
@@ -123,86 +203,2708 @@ void rbtree_insert_color(struct k_rbtree_node_t *node, struct k_rbtree_root_t *r
             tmp = parent->rbt_left;
             if (node == tmp) {
                 tmp = node->rbt_right;
-                parent->rbt_left = tmp;
-                node->rbt_right = parent;
+                K_RBTREE_WRITE_ONCE(parent->rbt_left, tmp);
+                K_RBTREE_WRITE_ONCE(node->rbt_right, parent);
                 if (tmp)
                     rbtree_set_parent_color(tmp, parent, K_RBTREE_BLACK);
                 rbtree_set_parent_color(parent, node, K_RBTREE_RED);
+                augment_rotate(parent, node);
                 parent = node;
                 tmp = node->rbt_left;
             }
 
-            gparent->rbt_right = tmp;
-            parent->rbt_left = gparent;
+            K_RBTREE_WRITE_ONCE(gparent->rbt_right, tmp);
+            K_RBTREE_WRITE_ONCE(parent->rbt_left, gparent);
             if (tmp)
                 rbtree_set_parent_color(tmp, gparent, K_RBTREE_BLACK);
             rbtree_rotate_set_parents(gparent, parent, root, K_RBTREE_RED);
+            augment_rotate(gparent, parent);
             break;
         }
     }
 }
 
-// Function to create a new node
-struct k_rbtree_node_t *create_node(int key)
+void rbtree_insert_color(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root)
+{
+    rbtree_insert_fixup(node, root, rbtree_dummy_rotate);
+}
+
+// Rebalance after erasing a black leaf below parent: the path through the
+// removed position is one black short
+static inline __attribute__((always_inline)) void
+rbtree_erase_fixup(struct k_rbtree_node_t *parent, struct k_rbtree_root_t *root,
+                   void (*augment_rotate)(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new))
+{
+    struct k_rbtree_node_t *node = NULL, *sibling, *tmp1, *tmp2;
+
+    while (1) {
+        sibling = parent->rbt_right;
+        if (node != sibling) {
+            // node is parent's left child (possibly NULL)
+            if (K_RBTREE_IS_RED(sibling)) {
+                // Case 1: left rotate at parent, the new sibling is black
+                tmp1 = sibling->rbt_left;
+                K_RBTREE_WRITE_ONCE(parent->rbt_right, tmp1);
+                K_RBTREE_WRITE_ONCE(sibling->rbt_left, parent);
+                rbtree_set_parent_color(tmp1, parent, K_RBTREE_BLACK);
+                rbtree_rotate_set_parents(parent, sibling, root, K_RBTREE_RED);
+                augment_rotate(parent, sibling);
+                sibling = tmp1;
+            }
+            tmp1 = sibling->rbt_right;
+            if (!tmp1 || K_RBTREE_IS_BLACK(tmp1)) {
+                tmp2 = sibling->rbt_left;
+                if (!tmp2 || K_RBTREE_IS_BLACK(tmp2)) {
+                    // Case 2: sibling color flip, push the deficit up
+                    rbtree_set_parent_color(sibling, parent, K_RBTREE_RED);
+                    if (K_RBTREE_IS_RED(parent))
+                        rbtree_set_black(parent);
+                    else {
+                        node = parent;
+                        parent = rbtree_parent(node);
+                        if (parent)
+                            continue;
+                    }
+                    break;
+                }
+                // Case 3: right rotate at sibling
+                tmp1 = tmp2->rbt_right;
+                K_RBTREE_WRITE_ONCE(sibling->rbt_left, tmp1);
+                K_RBTREE_WRITE_ONCE(tmp2->rbt_right, sibling);
+                K_RBTREE_WRITE_ONCE(parent->rbt_right, tmp2);
+                if (tmp1)
+                    rbtree_set_parent_color(tmp1, sibling, K_RBTREE_BLACK);
+                augment_rotate(sibling, tmp2);
+                tmp1 = sibling;
+                sibling = tmp2;
+            }
+            // Case 4: left rotate at parent and color flips
+            tmp2 = sibling->rbt_left;
+            K_RBTREE_WRITE_ONCE(parent->rbt_right, tmp2);
+            K_RBTREE_WRITE_ONCE(sibling->rbt_left, parent);
+            rbtree_set_parent_color(tmp1, sibling, K_RBTREE_BLACK);
+            if (tmp2)
+                rbtree_set_parent(tmp2, parent);
+            rbtree_rotate_set_parents(parent, sibling, root, K_RBTREE_BLACK);
+            augment_rotate(parent, sibling);
+            break;
+        } else {
+            sibling = parent->rbt_left;
+            if (K_RBTREE_IS_RED(sibling)) {
+                // Case 1: right rotate at parent
+                tmp1 = sibling->rbt_right;
+                K_RBTREE_WRITE_ONCE(parent->rbt_left, tmp1);
+                K_RBTREE_WRITE_ONCE(sibling->rbt_right, parent);
+                rbtree_set_parent_color(tmp1, parent, K_RBTREE_BLACK);
+                rbtree_rotate_set_parents(parent, sibling, root, K_RBTREE_RED);
+                augment_rotate(parent, sibling);
+                sibling = tmp1;
+            }
+            tmp1 = sibling->rbt_left;
+            if (!tmp1 || K_RBTREE_IS_BLACK(tmp1)) {
+                tmp2 = sibling->rbt_right;
+                if (!tmp2 || K_RBTREE_IS_BLACK(tmp2)) {
+                    // Case 2: sibling color flip
+                    rbtree_set_parent_color(sibling, parent, K_RBTREE_RED);
+                    if (K_RBTREE_IS_RED(parent))
+                        rbtree_set_black(parent);
+                    else {
+                        node = parent;
+                        parent = rbtree_parent(node);
+                        if (parent)
+                            continue;
+                    }
+                    break;
+                }
+                // Case 3: left rotate at sibling
+                tmp1 = tmp2->rbt_left;
+                K_RBTREE_WRITE_ONCE(sibling->rbt_right, tmp1);
+                K_RBTREE_WRITE_ONCE(tmp2->rbt_left, sibling);
+                K_RBTREE_WRITE_ONCE(parent->rbt_left, tmp2);
+                if (tmp1)
+                    rbtree_set_parent_color(tmp1, sibling, K_RBTREE_BLACK);
+                augment_rotate(sibling, tmp2);
+                tmp1 = sibling;
+                sibling = tmp2;
+            }
+            // Case 4: right rotate at parent and color flips
+            tmp2 = sibling->rbt_right;
+            K_RBTREE_WRITE_ONCE(parent->rbt_left, tmp2);
+            K_RBTREE_WRITE_ONCE(sibling->rbt_right, parent);
+            rbtree_set_parent_color(tmp1, sibling, K_RBTREE_BLACK);
+            if (tmp2)
+                rbtree_set_parent(tmp2, parent);
+            rbtree_rotate_set_parents(parent, sibling, root, K_RBTREE_BLACK);
+            augment_rotate(parent, sibling);
+            break;
+        }
+    }
+}
+
+// Unlink node, splicing in its successor when it has two children.
+// Returns the parent to rebalance from, or NULL if no fixup is needed.
+static inline __attribute__((always_inline)) struct k_rbtree_node_t *
+rbtree_erase_node(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root,
+                  const struct k_rbtree_augment_t *augment)
+{
+    struct k_rbtree_node_t *child = node->rbt_right;
+    struct k_rbtree_node_t *tmp = node->rbt_left;
+    struct k_rbtree_node_t *parent, *rebalance;
+    unsigned long pc;
+
+    if (!tmp) {
+        // At most one (right) child: if it exists it is red, recolor it
+        pc = node->rbt_parent_color;
+        parent = (struct k_rbtree_node_t *)(pc & ~3);
+        rbtree_change_child(node, child, parent, root);
+        if (child) {
+            child->rbt_parent_color = pc;
+            rebalance = NULL;
+        } else
+            rebalance = (pc & K_RBTREE_BLACK) ? parent : NULL;
+        tmp = parent;
+    } else if (!child) {
+        // Only a left child, necessarily red with a black parent
+        pc = node->rbt_parent_color;
+        tmp->rbt_parent_color = pc;
+        parent = (struct k_rbtree_node_t *)(pc & ~3);
+        rbtree_change_child(node, tmp, parent, root);
+        rebalance = NULL;
+        tmp = parent;
+    } else {
+        struct k_rbtree_node_t *successor = child, *child2;
+
+        tmp = child->rbt_left;
+        if (!tmp) {
+            // The right child is the successor
+            parent = successor;
+            child2 = successor->rbt_right;
+            augment->copy(node, successor);
+        } else {
+            // The successor is the leftmost node of the right subtree
+            do {
+                parent = successor;
+                successor = tmp;
+                tmp = tmp->rbt_left;
+            } while (tmp);
+            child2 = successor->rbt_right;
+            K_RBTREE_WRITE_ONCE(parent->rbt_left, child2);
+            K_RBTREE_WRITE_ONCE(successor->rbt_right, child);
+            rbtree_set_parent(child, successor);
+            augment->copy(node, successor);
+            augment->propagate(parent, successor);
+        }
+
+        tmp = node->rbt_left;
+        K_RBTREE_WRITE_ONCE(successor->rbt_left, tmp);
+        rbtree_set_parent(tmp, successor);
+
+        pc = node->rbt_parent_color;
+        rbtree_change_child(node, successor, (struct k_rbtree_node_t *)(pc & ~3), root);
+
+        if (child2) {
+            rbtree_set_parent_color(child2, parent, K_RBTREE_BLACK);
+            rebalance = NULL;
+        } else
+            rebalance = K_RBTREE_IS_BLACK(successor) ? parent : NULL;
+        successor->rbt_parent_color = pc;
+        tmp = successor;
+    }
+
+    // tmp is the lowest node whose subtree changed
+    augment->propagate(tmp, NULL);
+    return rebalance;
+}
+
+void rbtree_erase(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root)
+{
+    struct k_rbtree_node_t *rebalance = rbtree_erase_node(node, root, &rbtree_dummy_augment);
+
+    if (rebalance)
+        rbtree_erase_fixup(rebalance, root, rbtree_dummy_rotate);
+}
+
+// Augmented insert: node is linked (rbtree_link_node) but not yet
+// accounted for; its value and its ancestors' are computed here
+void rbtree_insert_augmented(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root,
+                             const struct k_rbtree_augment_t *augment)
+{
+    augment->propagate(node, NULL);
+    rbtree_insert_fixup(node, root, augment->rotate);
+}
+
+void rbtree_erase_augmented(struct k_rbtree_node_t *node, struct k_rbtree_root_t *root,
+                            const struct k_rbtree_augment_t *augment)
+{
+    struct k_rbtree_node_t *rebalance = rbtree_erase_node(node, root, augment);
+
+    if (rebalance)
+        rbtree_erase_fixup(rebalance, root, augment->rotate);
+}
+
+// Put new in victim's place without rebalancing. The caller keeps the
+// ordering valid, e.g. new has the same key or one between victim's
+// neighbours.
+void rbtree_replace_node(struct k_rbtree_node_t *victim, struct k_rbtree_node_t *new,
+                         struct k_rbtree_root_t *root)
+{
+    struct k_rbtree_node_t *parent = rbtree_parent(victim);
+
+    new->rbt_parent_color = victim->rbt_parent_color;
+    new->rbt_left = victim->rbt_left;
+    new->rbt_right = victim->rbt_right;
+
+    if (victim->rbt_left)
+        rbtree_set_parent(victim->rbt_left, new);
+    if (victim->rbt_right)
+        rbtree_set_parent(victim->rbt_right, new);
+    rbtree_change_child(victim, new, parent, root);
+}
+
+// Iteration without recursion or a stack, on the parent links
+struct k_rbtree_node_t *rbtree_first(const struct k_rbtree_root_t *root)
 {
-    struct k_rbtree_node_t *node = malloc(sizeof(struct k_rbtree_node_t));
-    node->key = key;
-    node->rbt_left = NULL;
-    node->rbt_right = NULL;
-    node->rbt_parent_color = K_RBTREE_RED;  // New nodes are red
+    struct k_rbtree_node_t *node = root->rbt_node;
+
+    if (!node)
+        return NULL;
+    while (node->rbt_left)
+        node = node->rbt_left;
     return node;
 }
 
-// Function to insert a new key
-void insert_key(struct k_rbtree_root_t *root, int key)
+struct k_rbtree_node_t *rbtree_last(const struct k_rbtree_root_t *root)
+{
+    struct k_rbtree_node_t *node = root->rbt_node;
+
+    if (!node)
+        return NULL;
+    while (node->rbt_right)
+        node = node->rbt_right;
+    return node;
+}
+
+// In-order successor, following parent links when there is no right subtree
+struct k_rbtree_node_t *rbtree_next(const struct k_rbtree_node_t *node)
+{
+    struct k_rbtree_node_t *parent;
+
+    if (node->rbt_right) {
+        node = node->rbt_right;
+        while (node->rbt_left)
+            node = node->rbt_left;
+        return (struct k_rbtree_node_t *)node;
+    }
+
+    while ((parent = rbtree_parent(node)) && node == parent->rbt_right)
+        node = parent;
+    return parent;
+}
+
+struct k_rbtree_node_t *rbtree_prev(const struct k_rbtree_node_t *node)
 {
-    struct k_rbtree_node_t *node = create_node(key);
-    struct k_rbtree_node_t *parent = NULL;
-    struct k_rbtree_node_t **p = &root->rbt_node;
+    struct k_rbtree_node_t *parent;
+
+    if (node->rbt_left) {
+        node = node->rbt_left;
+        while (node->rbt_right)
+            node = node->rbt_right;
+        return (struct k_rbtree_node_t *)node;
+    }
 
-    while (*p) {
-        parent = *p;
-        if (key < parent->key)
-            p = &parent->rbt_left;
+    while ((parent = rbtree_parent(node)) && node == parent->rbt_left)
+        node = parent;
+    return parent;
+}
+
+// Postorder: children before parents, so a node may be freed once the
+// iterator has moved past it (see K_RBTREE_POSTORDER_FOR_EACH_SAFE)
+static struct k_rbtree_node_t *rbtree_left_deepest(const struct k_rbtree_node_t *node)
+{
+    while (1) {
+        if (node->rbt_left)
+            node = node->rbt_left;
+        else if (node->rbt_right)
+            node = node->rbt_right;
         else
-            p = &parent->rbt_right;
+            return (struct k_rbtree_node_t *)node;
     }
+}
+
+struct k_rbtree_node_t *rbtree_first_postorder(const struct k_rbtree_root_t *root)
+{
+    return root->rbt_node ? rbtree_left_deepest(root->rbt_node) : NULL;
+}
+
+struct k_rbtree_node_t *rbtree_next_postorder(const struct k_rbtree_node_t *node)
+{
+    struct k_rbtree_node_t *parent = rbtree_parent(node);
+
+    // A left child with a right sibling: that subtree comes next
+    if (parent && node == parent->rbt_left && parent->rbt_right)
+        return rbtree_left_deepest(parent->rbt_right);
+    return parent;
+}
 
+#define K_RBTREE_POSTORDER_FOR_EACH_SAFE(pos, n, root)                      \
+    for (pos = rbtree_first_postorder(root);                                \
+         pos && (n = rbtree_next_postorder(pos), 1);                        \
+         pos = n)
+
+// Cached-root variants: leftmost says whether the insert descent went
+// left at every step, i.e. node is the new minimum
+void rbtree_insert_color_cached(struct k_rbtree_node_t *node, struct k_rbtree_root_cached_t *root, int leftmost)
+{
+    if (leftmost)
+        root->rbt_leftmost = node;
+    rbtree_insert_color(node, &root->rbt_root);
+}
+
+void rbtree_erase_cached(struct k_rbtree_node_t *node, struct k_rbtree_root_cached_t *root)
+{
+    if (root->rbt_leftmost == node)
+        root->rbt_leftmost = rbtree_next(node);
+    rbtree_erase(node, &root->rbt_root);
+}
+
+void rbtree_replace_node_cached(struct k_rbtree_node_t *victim, struct k_rbtree_node_t *new,
+                                struct k_rbtree_root_cached_t *root)
+{
+    if (root->rbt_leftmost == victim)
+        root->rbt_leftmost = new;
+    rbtree_replace_node(victim, new, &root->rbt_root);
+}
+
+// Remove and return the minimum. The leftmost node has no left child, so
+// its successor is its right child (a red leaf) or its parent: no descent.
+struct k_rbtree_node_t *rbtree_pop_first_cached(struct k_rbtree_root_cached_t *root)
+{
+    struct k_rbtree_node_t *node = root->rbt_leftmost;
+
+    if (!node)
+        return NULL;
+
+    root->rbt_leftmost = node->rbt_right ? node->rbt_right : rbtree_parent(node);
+    rbtree_erase(node, &root->rbt_root);
+    return node;
+}
+
+// Link nodes[lo, hi) below parent as a midpoint-split subtree. Nodes on
+// red_depth are red and all others black: midpoint splitting puts every
+// NULL link on the two deepest levels, so each path sees the same number
+// of black nodes.
+static struct k_rbtree_node_t *rbtree_build(struct k_rbtree_node_t **nodes, size_t lo, size_t hi,
+                                            struct k_rbtree_node_t *parent, int depth, int red_depth)
+{
+    struct k_rbtree_node_t *node;
+    size_t mid;
+
+    if (lo == hi)
+        return NULL;
+
+    mid = lo + (hi - lo) / 2;
+    node = nodes[mid];
+    rbtree_set_parent_color(node, parent, depth == red_depth ? K_RBTREE_RED : K_RBTREE_BLACK);
+    node->rbt_left = rbtree_build(nodes, lo, mid, node, depth + 1, red_depth);
+    node->rbt_right = rbtree_build(nodes, mid + 1, hi, node, depth + 1, red_depth);
+    return node;
+}
+
+// Build a valid red-black tree from n nodes already in key order in O(n),
+// without comparisons or rebalancing. Replaces whatever root held.
+void rbtree_build_sorted(struct k_rbtree_root_t *root, struct k_rbtree_node_t **nodes, size_t n)
+{
+    int deepest = 0;
+
+    while (((size_t)2 << deepest) - 1 < n)
+        deepest++;
+
+    // A lone root stays black
+    K_RBTREE_PUBLISH(root->rbt_node, rbtree_build(nodes, 0, n, NULL, 0, deepest ? deepest : -1));
+}
+
+void rbtree_build_sorted_cached(struct k_rbtree_root_cached_t *root, struct k_rbtree_node_t **nodes, size_t n)
+{
+    rbtree_build_sorted(&root->rbt_root, nodes, n);
+    root->rbt_leftmost = n ? nodes[0] : NULL;
+}
+
+// Link a new node below parent at *link; the caller then rebalances
+static inline void rbtree_link_node(struct k_rbtree_node_t *node, struct k_rbtree_node_t *parent,
+                                    struct k_rbtree_node_t **link)
+{
     node->rbt_parent_color = (unsigned long)parent;
-    *p = node;
+    K_RBTREE_WRITE_ONCE(node->rbt_left, NULL);   // A reused node may still be seen by readers
+    K_RBTREE_WRITE_ONCE(node->rbt_right, NULL);
+    K_RBTREE_PUBLISH(*link, node);
+}
 
-    rbtree_insert_color(node, root);
+void rbtree_seq_init(struct k_rbtree_seq_root_t *root)
+{
+    root->rbt_root.rbt_node = NULL;
+    root->seq = 0;
+    pthread_mutex_init(&root->lock, NULL);
 }
 
-// Function to print the tree in-order
-void print_inorder(struct k_rbtree_node_t *node)
+void rbtree_write_lock(struct k_rbtree_seq_root_t *root)
+{
+    pthread_mutex_lock(&root->lock);
+    __atomic_store_n(&root->seq, root->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void rbtree_write_unlock(struct k_rbtree_seq_root_t *root)
+{
+    __atomic_store_n(&root->seq, root->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&root->lock);
+}
+
+static inline unsigned long rbtree_read_begin(struct k_rbtree_seq_root_t *root)
+{
+    return __atomic_load_n(&root->seq, __ATOMIC_ACQUIRE);
+}
+
+// Non-zero if a writer was active at any point since rbtree_read_begin
+static inline int rbtree_read_retry(struct k_rbtree_seq_root_t *root, unsigned long seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || __atomic_load_n(&root->seq, __ATOMIC_RELAXED) != seq;
+}
+
+// Range scan callback, return non-zero to stop the scan
+typedef int (*k_rbtree_visit_t)(struct k_rbtree_node_t *node, void *arg);
+
+// Intrusive API: k_rbtree_node_t is embedded in the user's struct and
+// K_RBTREE_ENTRY gets back to the container. K_RBTREE_DEFINE generates
+// name_search, name_lower_bound (first entry with key >= key),
+// name_upper_bound (first with key > key), name_range (visit every entry
+// in [lo, hi) in order, O(log n + k)), name_search_seq (lockless lookup
+// on a k_rbtree_seq_root_t), name_insert and name_insert_cached for one
+// container type, with
+// cmp(key, entry->key_field) returning <0, 0 or >0 and inlined into
+// each descent. Equal keys are inserted to the right of existing ones,
+// so they stay in insertion order. name_insert_or_find is the
+// unique-key insert: it returns the entry already holding the key, or
+// links entry and returns NULL, in a single descent.
+#define K_RBTREE_ENTRY(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define K_RBTREE_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+#define K_RBTREE_DEFINE(name, type, member, key_type, key_field, cmp)                       \
+static inline type *name##_search(const struct k_rbtree_root_t *root, key_type key)        \
+{                                                                                           \
+    struct k_rbtree_node_t *node = root->rbt_node;                                          \
+    int c;                                                                                  \
+                                                                                            \
+    while (node) {                                                                          \
+        c = cmp(key, K_RBTREE_ENTRY(node, type, member)->key_field);                        \
+        if (c < 0)                                                                          \
+            node = node->rbt_left;                                                          \
+        else if (c > 0)                                                                     \
+            node = node->rbt_right;                                                         \
+        else                                                                                \
+            return K_RBTREE_ENTRY(node, type, member);                                      \
+    }                                                                                       \
+    return NULL;                                                                            \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_search_seq(struct k_rbtree_seq_root_t *root, key_type key)      \
+{                                                                                           \
+    struct k_rbtree_node_t *node;                                                           \
+    unsigned long seq;                                                                      \
+    type *entry;                                                                            \
+    int c, tries = 0;                                                                       \
+                                                                                            \
+    do {                                                                                    \
+        if (tries++ == RBTREE_SEQ_RETRIES) {                                                \
+            pthread_mutex_lock(&root->lock);                                                \
+            entry = name##_search(&root->rbt_root, key);                                    \
+            pthread_mutex_unlock(&root->lock);                                              \
+            return entry;                                                                   \
+        }                                                                                   \
+        seq = rbtree_read_begin(root);                                                      \
+        node = K_RBTREE_READ_ONCE(root->rbt_root.rbt_node);                                 \
+        while (node) {                                                                      \
+            c = cmp(key, K_RBTREE_ENTRY(node, type, member)->key_field);                    \
+            if (c < 0)                                                                      \
+                node = K_RBTREE_READ_ONCE(node->rbt_left);                                  \
+            else if (c > 0)                                                                 \
+                node = K_RBTREE_READ_ONCE(node->rbt_right);                                 \
+            else                                                                            \
+                return K_RBTREE_ENTRY(node, type, member);                                  \
+        }                                                                                   \
+    } while (rbtree_read_retry(root, seq));                                                 \
+    return NULL;                                                                            \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_lower_bound(const struct k_rbtree_root_t *root, key_type key)   \
+{                                                                                           \
+    struct k_rbtree_node_t *node = root->rbt_node, *best = NULL;                            \
+                                                                                            \
+    while (node) {                                                                          \
+        if (cmp(key, K_RBTREE_ENTRY(node, type, member)->key_field) <= 0) {                 \
+            best = node;                                                                    \
+            node = node->rbt_left;                                                          \
+        } else                                                                              \
+            node = node->rbt_right;                                                         \
+    }                                                                                       \
+    return best ? K_RBTREE_ENTRY(best, type, member) : NULL;                                \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_upper_bound(const struct k_rbtree_root_t *root, key_type key)   \
+{                                                                                           \
+    struct k_rbtree_node_t *node = root->rbt_node, *best = NULL;                            \
+                                                                                            \
+    while (node) {                                                                          \
+        if (cmp(key, K_RBTREE_ENTRY(node, type, member)->key_field) < 0) {                  \
+            best = node;                                                                    \
+            node = node->rbt_left;                                                          \
+        } else                                                                              \
+            node = node->rbt_right;                                                         \
+    }                                                                                       \
+    return best ? K_RBTREE_ENTRY(best, type, member) : NULL;                                \
+}                                                                                           \
+                                                                                            \
+static inline size_t name##_range(const struct k_rbtree_root_t *root, key_type lo,         \
+                                   key_type hi, k_rbtree_visit_t visit, void *arg)          \
+{                                                                                           \
+    type *entry = name##_lower_bound(root, lo);                                             \
+    struct k_rbtree_node_t *node = entry ? &entry->member : NULL;                           \
+    size_t cnt = 0;                                                                         \
+                                                                                            \
+    for (; node; node = rbtree_next(node)) {                                                \
+        if (cmp(hi, K_RBTREE_ENTRY(node, type, member)->key_field) <= 0)                    \
+            break;                                                                          \
+        cnt++;                                                                              \
+        if (visit(node, arg))                                                               \
+            break;                                                                          \
+    }                                                                                       \
+    return cnt;                                                                             \
+}                                                                                           \
+                                                                                            \
+static inline int name##_link(struct k_rbtree_root_t *root, type *entry)                   \
+{                                                                                           \
+    struct k_rbtree_node_t *parent = NULL;                                                  \
+    struct k_rbtree_node_t **p = &root->rbt_node;                                           \
+    int leftmost = 1;                                                                       \
+                                                                                            \
+    while (*p) {                                                                            \
+        parent = *p;                                                                        \
+        if (cmp(entry->key_field, K_RBTREE_ENTRY(parent, type, member)->key_field) < 0)     \
+            p = &parent->rbt_left;                                                          \
+        else {                                                                              \
+            p = &parent->rbt_right;                                                         \
+            leftmost = 0;                                                                   \
+        }                                                                                   \
+    }                                                                                       \
+    rbtree_link_node(&entry->member, parent, p);                                            \
+    return leftmost;                                                                        \
+}                                                                                           \
+                                                                                            \
+static inline void name##_insert(struct k_rbtree_root_t *root, type *entry)                \
+{                                                                                           \
+    name##_link(root, entry);                                                               \
+    rbtree_insert_color(&entry->member, root);                                              \
+}                                                                                           \
+                                                                                            \
+static inline void name##_insert_cached(struct k_rbtree_root_cached_t *root, type *entry)  \
+{                                                                                           \
+    int leftmost = name##_link(&root->rbt_root, entry);                                     \
+                                                                                            \
+    rbtree_insert_color_cached(&entry->member, root, leftmost);                             \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_insert_or_find(struct k_rbtree_root_t *root, type *entry)       \
+{                                                                                           \
+    struct k_rbtree_node_t *parent = NULL;                                                  \
+    struct k_rbtree_node_t **p = &root->rbt_node;                                           \
+    int c;                                                                                  \
+                                                                                            \
+    while (*p) {                                                                            \
+        parent = *p;                                                                        \
+        c = cmp(entry->key_field, K_RBTREE_ENTRY(parent, type, member)->key_field);         \
+        if (c < 0)                                                                          \
+            p = &parent->rbt_left;                                                          \
+        else if (c > 0)                                                                     \
+            p = &parent->rbt_right;                                                         \
+        else                                                                                \
+            return K_RBTREE_ENTRY(parent, type, member);                                    \
+    }                                                                                       \
+    rbtree_link_node(&entry->member, parent, p);                                            \
+    rbtree_insert_color(&entry->member, root);                                              \
+    return NULL;                                                                            \
+}
+
+// Multimap mode: only the first entry with a given key is linked into
+// the tree; later ones queue behind it on a circular k_rbtree_list_t, so
+// duplicates never add depth. Queued entries have their tree node marked
+// empty (K_RBTREE_CLEAR_NODE). K_RBTREE_DEFINE_MULTI generates
+// name_insert_multi, name_erase_multi (erasing the linked entry hands
+// its tree slot to the next duplicate without rebalancing) and
+// name_next_dup (the following entry with the same key, in insertion
+// order, or NULL) on top of a K_RBTREE_DEFINE(name, ...) for the same
+// type. name_search returns the oldest entry with the key.
+struct k_rbtree_list_t {
+    struct k_rbtree_list_t *next;
+    struct k_rbtree_list_t *prev;
+};
+
+#define K_RBTREE_CLEAR_NODE(r)  ((r)->rbt_parent_color = (unsigned long)(r))
+#define K_RBTREE_EMPTY_NODE(r)  ((r)->rbt_parent_color == (unsigned long)(r))
+
+static inline void rbtree_list_init(struct k_rbtree_list_t *list)
+{
+    list->next = list->prev = list;
+}
+
+static inline void rbtree_list_add_tail(struct k_rbtree_list_t *item, struct k_rbtree_list_t *head)
+{
+    item->next = head;
+    item->prev = head->prev;
+    head->prev->next = item;
+    head->prev = item;
+}
+
+static inline void rbtree_list_del(struct k_rbtree_list_t *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+}
+
+#define K_RBTREE_DEFINE_MULTI(name, type, member, list_member)                              \
+static inline void name##_insert_multi(struct k_rbtree_root_t *root, type *entry)          \
+{                                                                                           \
+    type *first = name##_insert_or_find(root, entry);                                       \
+                                                                                            \
+    if (first) {                                                                            \
+        K_RBTREE_CLEAR_NODE(&entry->member);                                                \
+        rbtree_list_add_tail(&entry->list_member, &first->list_member);                     \
+    } else                                                                                  \
+        rbtree_list_init(&entry->list_member);                                              \
+}                                                                                           \
+                                                                                            \
+static inline void name##_erase_multi(struct k_rbtree_root_t *root, type *entry)           \
+{                                                                                           \
+    struct k_rbtree_list_t *next = entry->list_member.next;                                 \
+    type *heir;                                                                             \
+                                                                                            \
+    if (K_RBTREE_EMPTY_NODE(&entry->member)) {                                              \
+        rbtree_list_del(&entry->list_member);                                               \
+        return;                                                                             \
+    }                                                                                       \
+    if (next == &entry->list_member) {                                                      \
+        rbtree_erase(&entry->member, root);                                                 \
+        return;                                                                             \
+    }                                                                                       \
+    heir = K_RBTREE_ENTRY(next, type, list_member);                                         \
+    rbtree_list_del(&entry->list_member);                                                   \
+    rbtree_replace_node(&entry->member, &heir->member, root);                               \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_next_dup(type *entry)                                           \
+{                                                                                           \
+    type *next = K_RBTREE_ENTRY(entry->list_member.next, type, list_member);                \
+                                                                                            \
+    return K_RBTREE_EMPTY_NODE(&next->member) ? next : NULL;                                \
+}
+
+// Node pool: fixed-size entries carved from cache-line-aligned chunks,
+// erased entries go on a freelist, and the whole pool is released in
+// one pass without walking the tree
+#define RBTREE_POOL_ALIGN   64
+#define RBTREE_POOL_CHUNK   (64 * 1024)     // Bytes per chunk, header included
+
+struct k_rbtree_pool_chunk_t {
+    struct k_rbtree_pool_chunk_t *next;
+};
+
+struct k_rbtree_pool_t {
+    size_t obj_size;
+    void *free_list;                        // Freed entries, linked through their first word
+    uint8_t *cur;                           // Bump pointer into the newest chunk
+    uint8_t *end;
+    struct k_rbtree_pool_chunk_t *chunks;
+};
+
+// Entries must fit in a chunk after its header line; returns -1 if
+// obj_size does not
+int rbtree_pool_init(struct k_rbtree_pool_t *pool, size_t obj_size)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (obj_size > RBTREE_POOL_CHUNK - RBTREE_POOL_ALIGN)
+        return -1;
+    obj_size = obj_size < sizeof(void *) ? sizeof(void *) : obj_size;
+    pool->obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    return 0;
+}
+
+void *rbtree_pool_alloc(struct k_rbtree_pool_t *pool)
 {
-    if (node) {
-        print_inorder(node->rbt_left);
-        printf("%d(%s) ", node->key, K_RBTREE_IS_RED(node) ? "R" : "B");
-        print_inorder(node->rbt_right);
+    struct k_rbtree_pool_chunk_t *chunk;
+    void *obj = pool->free_list;
+
+    if (obj) {
+        pool->free_list = *(void **)obj;
+        return obj;
+    }
+
+    if (!pool->cur || (size_t)(pool->end - pool->cur) < pool->obj_size) {
+        chunk = aligned_alloc(RBTREE_POOL_ALIGN, RBTREE_POOL_CHUNK);
+        if (!chunk)
+            return NULL;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        pool->cur = (uint8_t *)chunk + RBTREE_POOL_ALIGN;  // Entries start on a fresh line
+        pool->end = (uint8_t *)chunk + RBTREE_POOL_CHUNK;
     }
+
+    obj = pool->cur;
+    pool->cur += pool->obj_size;
+    return obj;
 }
 
-int main()
+void rbtree_pool_free(struct k_rbtree_pool_t *pool, void *obj)
 {
-    struct k_rbtree_root_t root = {NULL};
+    *(void **)obj = pool->free_list;
+    pool->free_list = obj;
+}
 
-    printf("Inserting numbers into Red-Black Tree...\n");
-    
-    // Test inserting some numbers
-    insert_key(&root, 10);
-    insert_key(&root, 5);
-    insert_key(&root, 15);
-    insert_key(&root, 3);
-    insert_key(&root, 7);
-    insert_key(&root, 12);
-    insert_key(&root, 18);
+// Bulk destroy: every entry from this pool is gone, the caller drops its
+// roots
+void rbtree_pool_destroy(struct k_rbtree_pool_t *pool)
+{
+    struct k_rbtree_pool_chunk_t *chunk, *next;
 
-    printf("\nInorder traversal of the tree (with colors):\n");
-    printf("Format: number(color) where R=Red, B=Black\n");
-    print_inorder(root.rbt_node);
-    printf("\n");
+    for (chunk = pool->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    rbtree_pool_init(pool, pool->obj_size);
+}
+
+// Subtree-size augmentation: embed k_rbtree_size_node_t in place of
+// k_rbtree_node_t to get O(log n) select and rank. K_RBTREE_DEFINE_SIZE
+// generates name_insert_size, name_erase_size, name_select (k-th
+// smallest, from 0) and name_rank (entries with key < key) on top of a
+// K_RBTREE_DEFINE(name, type, member.rbt, ...) for the same type.
+struct k_rbtree_size_node_t {
+    struct k_rbtree_node_t rbt;
+    size_t rbt_size;                        // Nodes in this subtree, itself included
+};
+
+#define K_RBTREE_SIZE_ENTRY(n) K_RBTREE_ENTRY(n, struct k_rbtree_size_node_t, rbt)
+
+static inline size_t rbtree_size(const struct k_rbtree_node_t *node)
+{
+    return node ? K_RBTREE_SIZE_ENTRY(node)->rbt_size : 0;
+}
+
+// Sizes change all the way up on every insert and erase, so no early stop
+static void rbtree_size_propagate(struct k_rbtree_node_t *node, struct k_rbtree_node_t *stop)
+{
+    while (node != stop) {
+        K_RBTREE_SIZE_ENTRY(node)->rbt_size = 1 + rbtree_size(node->rbt_left) + rbtree_size(node->rbt_right);
+        node = rbtree_parent(node);
+    }
+}
+
+static void rbtree_size_copy(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new)
+{
+    K_RBTREE_SIZE_ENTRY(new)->rbt_size = K_RBTREE_SIZE_ENTRY(old)->rbt_size;
+}
+
+static void rbtree_size_rotate(struct k_rbtree_node_t *old, struct k_rbtree_node_t *new)
+{
+    K_RBTREE_SIZE_ENTRY(new)->rbt_size = K_RBTREE_SIZE_ENTRY(old)->rbt_size;
+    K_RBTREE_SIZE_ENTRY(old)->rbt_size = 1 + rbtree_size(old->rbt_left) + rbtree_size(old->rbt_right);
+}
+
+static const struct k_rbtree_augment_t rbtree_size_augment = {
+    rbtree_size_propagate, rbtree_size_copy, rbtree_size_rotate
+};
+
+struct k_rbtree_node_t *rbtree_select(const struct k_rbtree_root_t *root, size_t k)
+{
+    struct k_rbtree_node_t *node = root->rbt_node;
+    size_t left;
+
+    while (node) {
+        left = rbtree_size(node->rbt_left);
+        if (k < left)
+            node = node->rbt_left;
+        else if (k == left)
+            return node;
+        else {
+            k -= left + 1;
+            node = node->rbt_right;
+        }
+    }
+    return NULL;
+}
+
+#define K_RBTREE_DEFINE_SIZE(name, type, member, key_type, key_field, cmp)                  \
+static inline void name##_insert_size(struct k_rbtree_root_t *root, type *entry)           \
+{                                                                                           \
+    name##_link(root, entry);                                                               \
+    rbtree_insert_augmented(&entry->member.rbt, root, &rbtree_size_augment);                \
+}                                                                                           \
+                                                                                            \
+static inline void name##_erase_size(struct k_rbtree_root_t *root, type *entry)            \
+{                                                                                           \
+    rbtree_erase_augmented(&entry->member.rbt, root, &rbtree_size_augment);                 \
+}                                                                                           \
+                                                                                            \
+static inline type *name##_select(const struct k_rbtree_root_t *root, size_t k)            \
+{                                                                                           \
+    struct k_rbtree_node_t *node = rbtree_select(root, k);                                  \
+                                                                                            \
+    return node ? K_RBTREE_ENTRY(node, type, member.rbt) : NULL;                            \
+}                                                                                           \
+                                                                                            \
+static inline size_t name##_rank(const struct k_rbtree_root_t *root, key_type key)         \
+{                                                                                           \
+    struct k_rbtree_node_t *node = root->rbt_node;                                          \
+    size_t rank = 0;                                                                        \
+                                                                                            \
+    while (node) {                                                                          \
+        if (cmp(key, K_RBTREE_ENTRY(node, type, member.rbt)->key_field) <= 0)               \
+            node = node->rbt_left;                                                          \
+        else {                                                                              \
+            rank += rbtree_size(node->rbt_left) + 1;                                        \
+            node = node->rbt_right;                                                         \
+        }                                                                                   \
+    }                                                                                       \
+    return rank;                                                                            \
+}
+
+// B+tree alternative for large in-memory indexes: each node holds
+// BTREE_KEYS int64_t keys in two cache lines and is searched with SIMD
+// compares (AVX2, SSE4.2, or a branchless scalar loop, picked at build
+// time, e.g. -mavx2), so a lookup costs about one miss per level on a
+// tree a handful of levels deep. Keys are unique; values are opaque
+// non-NULL pointers. Leaves are chained for in-order scans. Erase does
+// not merge underfull nodes, but a leaf that empties is unlinked and
+// freed, and so is any inner node left without children, so memory and
+// scan cost follow the live keys.
+#define BTREE_KEYS          16
+#define BTREE_PAD           INT64_MAX   // Unused key slots, never below a search key
+#define BTREE_MAX_DEPTH     64
+
+struct k_btree_node_t {
+    int64_t keys[BTREE_KEYS];
+    struct k_btree_node_t *next;        // Leaves: right sibling
+    uint16_t count;
+    uint16_t leaf;
+    union {
+        void *values[BTREE_KEYS];
+        struct k_btree_node_t *child[BTREE_KEYS + 1];
+    };
+} __attribute__((aligned(64)));
+
+struct k_btree_t {
+    struct k_btree_node_t *root;
+    size_t count;
+};
+
+struct k_btree_iter_t {
+    struct k_btree_node_t *node;
+    int pos;
+};
+
+// Number of keys in node below key, i.e. the lower-bound position
+static inline int btree_lower_pos(const struct k_btree_node_t *node, int64_t key)
+{
+    int n = 0;
+
+#if defined(__AVX2__)
+    __m256i k = _mm256_set1_epi64x(key);
+
+    for (int i = 0; i < BTREE_KEYS; i += 4) {
+        __m256i v = _mm256_load_si256((const __m256i *)&node->keys[i]);
+        n += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v))));
+    }
+#elif defined(__SSE4_2__)
+    __m128i k = _mm_set1_epi64x(key);
+
+    for (int i = 0; i < BTREE_KEYS; i += 2) {
+        __m128i v = _mm_load_si128((const __m128i *)&node->keys[i]);
+        n += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v))));
+    }
+#else
+    for (int i = 0; i < BTREE_KEYS; i++)
+        n += node->keys[i] < key;
+#endif
+    return n;
+}
+
+// Child to descend into: the number of separators <= key
+static inline int btree_upper_pos(const struct k_btree_node_t *node, int64_t key)
+{
+    return key == INT64_MAX ? node->count : btree_lower_pos(node, key + 1);
+}
+
+static struct k_btree_node_t *btree_node_new(int leaf)
+{
+    struct k_btree_node_t *node = aligned_alloc(64, sizeof(struct k_btree_node_t));
+
+    if (!node)
+        return NULL;
+    for (int i = 0; i < BTREE_KEYS; i++)
+        node->keys[i] = BTREE_PAD;
+    node->next = NULL;
+    node->count = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+// Split the full parent->child[idx]; parent has room for one more key
+static int btree_split_child(struct k_btree_node_t *parent, int idx)
+{
+    struct k_btree_node_t *left = parent->child[idx], *right = btree_node_new(left->leaf);
+    int half = BTREE_KEYS / 2;
+    int64_t sep;
+
+    if (!right)
+        return -1;
+
+    if (left->leaf) {
+        // The upper half moves, its first key is copied up
+        right->count = BTREE_KEYS - half;
+        memcpy(right->keys, left->keys + half, right->count * sizeof(int64_t));
+        memcpy(right->values, left->values + half, right->count * sizeof(void *));
+        right->next = left->next;
+        left->next = right;
+        sep = right->keys[0];
+    } else {
+        // The middle key moves up
+        sep = left->keys[half];
+        right->count = BTREE_KEYS - half - 1;
+        memcpy(right->keys, left->keys + half + 1, right->count * sizeof(int64_t));
+        memcpy(right->child, left->child + half + 1, (right->count + 1) * sizeof(void *));
+    }
+    for (int i = half; i < BTREE_KEYS; i++)
+        left->keys[i] = BTREE_PAD;
+    left->count = half;
+
+    memmove(parent->keys + idx + 1, parent->keys + idx, (parent->count - idx) * sizeof(int64_t));
+    memmove(parent->child + idx + 2, parent->child + idx + 1, (parent->count - idx) * sizeof(void *));
+    parent->keys[idx] = sep;
+    parent->child[idx + 1] = right;
+    parent->count++;
+    return 0;
+}
+
+// Returns 0 when inserted, 1 when key already exists (value untouched),
+// -1 when out of memory. Full nodes are split on the way down.
+int btree_insert(struct k_btree_t *tree, int64_t key, void *value)
+{
+    struct k_btree_node_t *node = tree->root, *top;
+    int idx;
+
+    if (!node) {
+        node = tree->root = btree_node_new(1);
+        if (!node)
+            return -1;
+    }
+    if (node->count == BTREE_KEYS) {
+        top = btree_node_new(0);
+        if (!top)
+            return -1;
+        top->child[0] = node;
+        if (btree_split_child(top, 0) != 0) {
+            free(top);
+            return -1;
+        }
+        node = tree->root = top;
+    }
+
+    while (!node->leaf) {
+        idx = btree_upper_pos(node, key);
+        if (node->child[idx]->count == BTREE_KEYS) {
+            if (btree_split_child(node, idx) != 0)
+                return -1;
+            if (key >= node->keys[idx])
+                idx++;
+        }
+        node = node->child[idx];
+    }
+
+    idx = btree_lower_pos(node, key);
+    if (idx < node->count && node->keys[idx] == key)
+        return 1;
+    memmove(node->keys + idx + 1, node->keys + idx, (node->count - idx) * sizeof(int64_t));
+    memmove(node->values + idx + 1, node->values + idx, (node->count - idx) * sizeof(void *));
+    node->keys[idx] = key;
+    node->values[idx] = value;
+    node->count++;
+    tree->count++;
+    return 0;
+}
+
+static inline struct k_btree_node_t *btree_leaf(const struct k_btree_t *tree, int64_t key)
+{
+    struct k_btree_node_t *node = tree->root;
+
+    while (node && !node->leaf)
+        node = node->child[btree_upper_pos(node, key)];
+    return node;
+}
+
+void *btree_search(const struct k_btree_t *tree, int64_t key)
+{
+    struct k_btree_node_t *node = btree_leaf(tree, key);
+    int pos;
+
+    if (!node)
+        return NULL;
+    pos = btree_lower_pos(node, key);
+    return (pos < node->count && node->keys[pos] == key) ? node->values[pos] : NULL;
+}
+
+// Rightmost leaf left of the subtree path[depth] leads into, NULL if
+// that subtree holds the first leaf
+static struct k_btree_node_t *btree_prev_leaf(struct k_btree_node_t **path, int *idx, int depth)
+{
+    struct k_btree_node_t *node;
+
+    while (--depth >= 0 && idx[depth] == 0)
+        ;
+    if (depth < 0)
+        return NULL;
+    node = path[depth]->child[idx[depth] - 1];
+    while (!node->leaf)
+        node = node->child[node->count];
+    return node;
+}
+
+// Drop child idx from an inner node with its separator: the left
+// neighbour's range grows over it, or for child 0 the right one's
+static void btree_remove_child(struct k_btree_node_t *node, int idx)
+{
+    int sep = idx ? idx - 1 : 0;
+
+    memmove(node->keys + sep, node->keys + sep + 1, (node->count - sep - 1) * sizeof(int64_t));
+    memmove(node->child + idx, node->child + idx + 1, (node->count - idx) * sizeof(void *));
+    node->count--;
+    node->keys[node->count] = BTREE_PAD;
+}
+
+// Returns 1 if key was present
+int btree_erase(struct k_btree_t *tree, int64_t key)
+{
+    struct k_btree_node_t *path[BTREE_MAX_DEPTH], *node = tree->root, *prev;
+    int idx[BTREE_MAX_DEPTH], depth = 0, pos;
+
+    if (!node)
+        return 0;
+    while (!node->leaf) {
+        path[depth] = node;
+        idx[depth] = btree_upper_pos(node, key);
+        node = node->child[idx[depth++]];
+    }
+    pos = btree_lower_pos(node, key);
+    if (pos >= node->count || node->keys[pos] != key)
+        return 0;
+
+    node->count--;
+    memmove(node->keys + pos, node->keys + pos + 1, (node->count - pos) * sizeof(int64_t));
+    memmove(node->values + pos, node->values + pos + 1, (node->count - pos) * sizeof(void *));
+    node->keys[node->count] = BTREE_PAD;
+    tree->count--;
+    if (node->count)
+        return 1;
+
+    // Unlink the empty leaf from the chain, then free it and every inner
+    // node that loses its last child with it
+    prev = btree_prev_leaf(path, idx, depth);
+    if (prev)
+        prev->next = node->next;
+    for (;;) {
+        free(node);
+        if (depth == 0) {
+            tree->root = NULL;
+            return 1;
+        }
+        node = path[--depth];
+        if (node->count) {
+            btree_remove_child(node, idx[depth]);
+            break;
+        }
+    }
+
+    // A root left with a single child hands over to it
+    while (!tree->root->leaf && tree->root->count == 0) {
+        node = tree->root;
+        tree->root = node->child[0];
+        free(node);
+    }
+    return 1;
+}
+
+// Iteration: it->node->keys[it->pos] / values[it->pos] while the call
+// returned 1
+static inline int btree_iter_settle(struct k_btree_iter_t *it)
+{
+    while (it->node && it->pos >= it->node->count) {
+        it->node = it->node->next;
+        it->pos = 0;
+    }
+    return it->node != NULL;
+}
+
+int btree_lower_bound(const struct k_btree_t *tree, int64_t key, struct k_btree_iter_t *it)
+{
+    it->node = btree_leaf(tree, key);
+    it->pos = it->node ? btree_lower_pos(it->node, key) : 0;
+    return btree_iter_settle(it);
+}
+
+int btree_first(const struct k_btree_t *tree, struct k_btree_iter_t *it)
+{
+    return btree_lower_bound(tree, INT64_MIN, it);
+}
+
+int btree_next(struct k_btree_iter_t *it)
+{
+    it->pos++;
+    return btree_iter_settle(it);
+}
+
+static void btree_free_node(struct k_btree_node_t *node)
+{
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++)
+            btree_free_node(node->child[i]);
+    }
+    free(node);
+}
+
+void btree_destroy(struct k_btree_t *tree)
+{
+    if (tree->root)
+        btree_free_node(tree->root);
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+// Test entries keyed by int
+struct test_node_t {
+    int key;
+    struct k_rbtree_node_t node;
+};
+
+K_RBTREE_DEFINE(test_rbtree, struct test_node_t, node, int, key, K_RBTREE_CMP_NUM)
+
+#define TEST_ENTRY(n) K_RBTREE_ENTRY(n, struct test_node_t, node)
+
+// Test entries with subtree sizes
+struct test_os_node_t {
+    int key;
+    struct k_rbtree_size_node_t snode;
+};
+
+K_RBTREE_DEFINE(test_os, struct test_os_node_t, snode.rbt, int, key, K_RBTREE_CMP_NUM)
+K_RBTREE_DEFINE_SIZE(test_os, struct test_os_node_t, snode, int, key, K_RBTREE_CMP_NUM)
+
+// Multimap test entries: seq records insertion order
+struct test_multi_t {
+    int key;
+    int seq;
+    struct k_rbtree_node_t node;
+    struct k_rbtree_list_t dups;
+};
+
+K_RBTREE_DEFINE(test_multi, struct test_multi_t, node, int, key, K_RBTREE_CMP_NUM)
+K_RBTREE_DEFINE_MULTI(test_multi, struct test_multi_t, node, dups)
+
+// Function to create a new node
+struct test_node_t *create_node(int key)
+{
+    struct test_node_t *entry = malloc(sizeof(struct test_node_t));
+    entry->key = key;
+    entry->node.rbt_left = NULL;
+    entry->node.rbt_right = NULL;
+    entry->node.rbt_parent_color = K_RBTREE_RED;  // New nodes are red
+    return entry;
+}
+
+// Function to insert a new key
+void insert_key(struct k_rbtree_root_t *root, int key)
+{
+    test_rbtree_insert(root, create_node(key));
+}
+
+// Function to print the tree in-order
+void print_inorder(const struct k_rbtree_root_t *root)
+{
+    for (struct k_rbtree_node_t *node = rbtree_first(root); node; node = rbtree_next(node))
+        printf("%d(%s) ", TEST_ENTRY(node)->key, K_RBTREE_IS_RED(node) ? "R" : "B");
+}
+
+// Check the red-black properties below node: BST order within (lo, hi),
+// parent links, no red node with a red child, equal black height on
+// every path. Returns the black height, or -1 on a violation.
+static int rbtree_check(struct k_rbtree_node_t *node, struct k_rbtree_node_t *parent,
+                        long lo, long hi, size_t *count)
+{
+    int lh, rh;
+
+    if (!node)
+        return 1;
+
+    if (rbtree_parent(node) != parent || TEST_ENTRY(node)->key <= lo || TEST_ENTRY(node)->key >= hi)
+        return -1;
+    if (K_RBTREE_IS_RED(node) &&
+        ((node->rbt_left && K_RBTREE_IS_RED(node->rbt_left)) ||
+         (node->rbt_right && K_RBTREE_IS_RED(node->rbt_right))))
+        return -1;
+
+    (*count)++;
+    lh = rbtree_check(node->rbt_left, node, lo, TEST_ENTRY(node)->key, count);
+    rh = rbtree_check(node->rbt_right, node, TEST_ENTRY(node)->key, hi, count);
+    if (lh < 0 || lh != rh)
+        return -1;
+
+    return lh + K_RBTREE_IS_BLACK(node);
+}
+
+static int rbtree_valid(struct k_rbtree_root_t *root, size_t expect)
+{
+    size_t count = 0;
+
+    if (root->rbt_node && K_RBTREE_IS_RED(root->rbt_node))
+        return 0;
+    return rbtree_check(root->rbt_node, NULL, (long)INT32_MIN - 1, (long)INT32_MAX + 1, &count) > 0 &&
+           count == expect;
+}
+
+static uint64_t rbtree_rand_state = 0x9e3779b97f4a7c15ull;
+
+static uint32_t rbtree_rand(void)
+{
+    rbtree_rand_state ^= rbtree_rand_state << 13;
+    rbtree_rand_state ^= rbtree_rand_state >> 7;
+    rbtree_rand_state ^= rbtree_rand_state << 17;
+    return (uint32_t)rbtree_rand_state;
+}
+
+// Per-thread generator for the concurrent tests
+static uint32_t rbtree_rand_r(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)*state;
+}
+
+#define RBTREE_STRESS_OPS   10000000    // ./rbtree_test stress
+#define RBTREE_STRESS_KEYS  256         // Small key range so erases hit
+
+// Random inserts, erases and replaces against a presence map, with a full
+// invariant check after every operation
+void test_rbtree_stress(long ops)
+{
+    static char present[RBTREE_STRESS_KEYS];
+    struct k_rbtree_root_t root = {NULL};
+    struct test_node_t *entry, *new;
+    struct k_rbtree_node_t *pos, *n;
+    size_t count = 0;
+    long errors = 0, erased = 0, replaced = 0;
+    int key;
+
+    printf("\nStress test: %ld random insert/erase/replace ops, keys 0..%d\n", ops, RBTREE_STRESS_KEYS - 1);
+    memset(present, 0, sizeof(present));
+
+    for (long i = 0; i < ops; i++) {
+        key = rbtree_rand() % RBTREE_STRESS_KEYS;
+        entry = test_rbtree_search(&root, key);
+        if ((entry != NULL) != present[key]) {
+            errors++;
+        }
+
+        if (!entry) {
+            insert_key(&root, key);
+            present[key] = 1;
+            count++;
+        } else if (rbtree_rand() % 8 == 0) {
+            new = create_node(key);
+            rbtree_replace_node(&entry->node, &new->node, &root);
+            free(entry);
+            replaced++;
+        } else {
+            rbtree_erase(&entry->node, &root);
+            free(entry);
+            present[key] = 0;
+            count--;
+            erased++;
+        }
+
+        if (!rbtree_valid(&root, count)) {
+            errors++;
+        }
+    }
+
+    printf("%ld erased, %ld replaced, %zu left, %ld errors\n", erased, replaced, count, errors);
+
+    K_RBTREE_POSTORDER_FOR_EACH_SAFE(pos, n, &root)
+        free(TEST_ENTRY(pos));
+}
+
+// Leftmost cache against the tree minimum through random inserts, erases
+// and pops
+void test_rbtree_cached(void)
+{
+    struct k_rbtree_root_cached_t root = {{NULL}, NULL};
+    struct k_rbtree_node_t *node, *min;
+    struct test_node_t *entry;
+    size_t count = 0;
+    long errors = 0;
+    int last = -1;
+
+    printf("\nTesting cached leftmost root...\n");
+    for (long i = 0; i < 200000; i++) {
+        int key = rbtree_rand() % 1024;
+
+        if (rbtree_rand() % 2) {
+            test_rbtree_insert_cached(&root, create_node(key));
+            count++;
+        } else if ((entry = test_rbtree_search(&root.rbt_root, key))) {
+            rbtree_erase_cached(&entry->node, &root);
+            free(entry);
+            count--;
+        }
+
+        min = rbtree_first(&root.rbt_root);
+        if (K_RBTREE_FIRST_CACHED(&root) != min)
+            errors++;
+    }
+
+    // Draining by pop-min yields sorted keys
+    while ((node = rbtree_pop_first_cached(&root))) {
+        if (TEST_ENTRY(node)->key < last)
+            errors++;
+        last = TEST_ENTRY(node)->key;
+        free(TEST_ENTRY(node));
+        count--;
+    }
+    printf("leftmost mismatches and order errors: %ld, %zu left\n", errors, count);
+}
+
+// One object in two trees at once, by id and by name, plus lower_bound
+struct test_obj_t {
+    uint64_t id;
+    const char *name;
+    struct k_rbtree_node_t by_id;
+    struct k_rbtree_node_t by_name;
+};
+
+K_RBTREE_DEFINE(test_obj_id, struct test_obj_t, by_id, uint64_t, id, K_RBTREE_CMP_NUM)
+K_RBTREE_DEFINE(test_obj_name, struct test_obj_t, by_name, const char *, name, strcmp)
+
+void test_rbtree_intrusive(void)
+{
+    static struct test_obj_t objs[] = {
+        {40, "timer", {0}, {0}}, {10, "uart", {0}, {0}}, {30, "gpio", {0}, {0}},
+        {20, "spi", {0}, {0}}, {50, "i2c", {0}, {0}},
+    };
+    struct k_rbtree_root_t ids = {NULL}, names = {NULL};
+    struct test_obj_t *obj;
+    int errors = 0;
+
+    printf("\nTesting intrusive multi-key entries...\n");
+    for (size_t i = 0; i < sizeof(objs) / sizeof(objs[0]); i++) {
+        test_obj_id_insert(&ids, &objs[i]);
+        test_obj_name_insert(&names, &objs[i]);
+    }
+
+    obj = test_obj_name_search(&names, "spi");
+    printf("search name \"spi\": id %llu\n", obj ? (unsigned long long)obj->id : 0ull);
+    obj = test_obj_id_search(&ids, 30);
+    printf("search id 30: %s\n", obj ? obj->name : "(none)");
+    obj = test_obj_id_lower_bound(&ids, 31);
+    printf("lower_bound id 31: %s\n", obj ? obj->name : "(none)");
+    obj = test_obj_name_lower_bound(&names, "j");
+    printf("lower_bound name \"j\": %s\n", obj ? obj->name : "(none)");
+
+    if (test_obj_id_lower_bound(&ids, 51) != NULL || test_obj_id_lower_bound(&ids, 0) != &objs[1] ||
+        test_obj_name_search(&names, "spix") != NULL || test_obj_id_lower_bound(&ids, 50) != &objs[4])
+        errors++;
+
+    // Removing from one tree leaves the other intact
+    rbtree_erase(&objs[3].by_id, &ids);
+    if (test_obj_id_search(&ids, 20) != NULL || test_obj_name_search(&names, "spi") != &objs[3])
+        errors++;
+    printf("edge cases: %d errors\n", errors);
+}
+
+// Pool-backed tree: freelist reuse, chunk alignment, bulk destroy
+void test_rbtree_pool(void)
+{
+    struct k_rbtree_pool_t pool;
+    struct k_rbtree_root_t root = {NULL};
+    struct test_node_t *entry, *first;
+    size_t count = 0;
+    int errors = 0;
+
+    printf("\nTesting rbtree node pool...\n");
+    if (rbtree_pool_init(&pool, RBTREE_POOL_CHUNK) != -1 ||
+        rbtree_pool_init(&pool, RBTREE_POOL_CHUNK - RBTREE_POOL_ALIGN) != 0)
+        errors++;
+    entry = rbtree_pool_alloc(&pool);
+    if (!entry || (uint8_t *)entry + pool.obj_size != (uint8_t *)pool.chunks + RBTREE_POOL_CHUNK)
+        errors++;
+    rbtree_pool_destroy(&pool);
+    if (rbtree_pool_init(&pool, sizeof(struct test_node_t)) != 0)
+        errors++;
+
+    for (int i = 0; i < 100000; i++) {
+        entry = rbtree_pool_alloc(&pool);
+        entry->key = i * 2;
+        test_rbtree_insert(&root, entry);
+        count++;
+    }
+    if (((uintptr_t)pool.chunks & (RBTREE_POOL_ALIGN - 1)) != 0)
+        errors++;
+
+    // Erase the multiples of 4, re-insert odd keys into the freed entries
+    for (int i = 0; i < 200000; i += 4) {
+        entry = test_rbtree_search(&root, i);
+        rbtree_erase(&entry->node, &root);
+        rbtree_pool_free(&pool, entry);
+        count--;
+    }
+    first = pool.free_list;
+    entry = rbtree_pool_alloc(&pool);
+    if (entry != first)
+        errors++;
+    rbtree_pool_free(&pool, entry);
+    for (int i = 1; i < 100000; i += 2) {
+        entry = rbtree_pool_alloc(&pool);
+        entry->key = i;
+        test_rbtree_insert(&root, entry);
+        count++;
+    }
+    if (pool.free_list != NULL || !rbtree_valid(&root, count))
+        errors++;
+
+    rbtree_pool_destroy(&pool);
+    root.rbt_node = NULL;
+    printf("%zu entries of %zu bytes, %d errors\n", count, pool.obj_size, errors);
+}
+
+// Bulk build for every size up to 1000: valid colors, in order, and the
+// tree stays valid through inserts and erases afterwards
+void test_rbtree_build(void)
+{
+    static struct test_node_t entries[1000];
+    static struct k_rbtree_node_t *nodes[1000];
+    struct k_rbtree_root_cached_t root;
+    struct test_node_t *entry;
+    int errors = 0;
+
+    printf("\nTesting sorted bulk build...\n");
+    for (size_t n = 0; n <= 1000; n++) {
+        for (size_t i = 0; i < n; i++) {
+            entries[i].key = (int)i * 2;
+            nodes[i] = &entries[i].node;
+        }
+        rbtree_build_sorted_cached(&root, nodes, n);
+        if (!rbtree_valid(&root.rbt_root, n) || K_RBTREE_FIRST_CACHED(&root) != (n ? nodes[0] : NULL))
+            errors++;
+
+        if (n % 100 == 0 && n) {
+            entry = create_node(-1);
+            test_rbtree_insert_cached(&root, entry);
+            rbtree_erase_cached(&entries[n / 2].node, &root);
+            if (!rbtree_valid(&root.rbt_root, n) || K_RBTREE_FIRST_CACHED(&root) != &entry->node)
+                errors++;
+            free(entry);
+        }
+    }
+    printf("sizes 0..1000: %d errors\n", errors);
+}
+
+struct test_range_t {
+    long sum;
+    int last;
+    int stop_after;
+    int errors;
+};
+
+static int test_range_visit(struct k_rbtree_node_t *node, void *arg)
+{
+    struct test_range_t *r = arg;
+
+    if (TEST_ENTRY(node)->key < r->last)
+        r->errors++;
+    r->last = TEST_ENTRY(node)->key;
+    r->sum += r->last;
+    return --r->stop_after == 0;
+}
+
+// Iterators, bounds and range scans against brute force over even keys
+// 0..1998, and postorder visiting children before parents
+void test_rbtree_iter(void)
+{
+    static struct test_node_t entries[1000];
+    static char seen[1000];
+    struct k_rbtree_root_t root = {NULL};
+    struct k_rbtree_node_t *node, *n;
+    struct test_node_t *entry;
+    struct test_range_t r;
+    int errors = 0, i = 0;
+
+    printf("\nTesting iterators and range scans...\n");
+    for (int k = 0; k < 1000; k++) {
+        entries[k].key = k * 2;
+        test_rbtree_insert(&root, &entries[k]);
+    }
+
+    for (node = rbtree_first(&root); node; node = rbtree_next(node))
+        errors += TEST_ENTRY(node)->key != 2 * i++;
+    for (node = rbtree_last(&root); node; node = rbtree_prev(node))
+        errors += TEST_ENTRY(node)->key != 2 * --i;
+
+    for (int k = -3; k < 2003; k++) {
+        int lb = k <= 0 ? 0 : (k + 1) / 2 * 2, ub = k < 0 ? 0 : k / 2 * 2 + 2;
+
+        entry = test_rbtree_lower_bound(&root, k);
+        errors += entry ? entry->key != lb : lb <= 1998;
+        entry = test_rbtree_upper_bound(&root, k);
+        errors += entry ? entry->key != ub : ub <= 1998;
+    }
+
+    for (int lo = -5; lo < 2005; lo += 37) {
+        for (int hi = lo; hi < lo + 300; hi += 29) {
+            long expect = 0;
+            size_t cnt;
+
+            for (int k = lo < 0 ? 0 : (lo + 1) / 2 * 2; k < hi && k <= 1998; k += 2)
+                expect += k;
+            memset(&r, 0, sizeof(r));
+            r.last = -1;
+            r.stop_after = -1;
+            cnt = test_rbtree_range(&root, lo, hi, test_range_visit, &r);
+            errors += r.sum != expect || r.errors || (long)cnt * 2 > hi - lo + 2;
+        }
+    }
+    memset(&r, 0, sizeof(r));
+    r.stop_after = 3;
+    errors += test_rbtree_range(&root, 100, 200, test_range_visit, &r) != 3 || r.sum != 100 + 102 + 104;
+
+    i = 0;
+    K_RBTREE_POSTORDER_FOR_EACH_SAFE(node, n, &root) {
+        entry = TEST_ENTRY(node);
+        if ((node->rbt_left && !seen[TEST_ENTRY(node->rbt_left)->key / 2]) ||
+            (node->rbt_right && !seen[TEST_ENTRY(node->rbt_right)->key / 2]))
+            errors++;
+        seen[entry->key / 2] = 1;
+        memset(node, 0xa5, sizeof(*node));  // As if freed
+        i++;
+    }
+    printf("1000 keys, postorder visited %d, %d errors\n", i, errors);
+}
+
+#define TEST_SEQ_KEYS       4096
+#define TEST_SEQ_READERS    3
+
+struct test_seq_arg_t {
+    struct k_rbtree_seq_root_t *root;
+    struct test_node_t *entries;
+    int stop;
+    int use_lock;           // Benchmark baseline: readers take the lock too
+    uint64_t seed;
+    long lookups;
+    long errors;
+    long updates;
+};
+
+// Toggle odd keys in and out under the write lock; even keys stay put,
+// so every lookup of an even key must hit
+static void *test_seq_writer(void *p)
+{
+    struct test_seq_arg_t *arg = p;
+    char present[TEST_SEQ_KEYS / 2];
+    struct timespec pause = {0, 0};
+    int k;
+
+    memset(present, 1, sizeof(present));
+    while (!__atomic_load_n(&arg->stop, __ATOMIC_RELAXED)) {
+        k = rbtree_rand_r(&arg->seed) % (TEST_SEQ_KEYS / 2);
+        rbtree_write_lock(arg->root);
+        if (present[k])
+            rbtree_erase(&arg->entries[2 * k + 1].node, &arg->root->rbt_root);
+        else
+            test_rbtree_insert(&arg->root->rbt_root, &arg->entries[2 * k + 1]);
+        rbtree_write_unlock(arg->root);
+        present[k] = !present[k];
+        arg->updates++;
+        if (arg->use_lock >= 0) {
+            pause.tv_nsec = 100000;     // Read-mostly benchmark: 10k updates/s
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    // Leave every odd key in the tree
+    rbtree_write_lock(arg->root);
+    for (k = 0; k < TEST_SEQ_KEYS / 2; k++) {
+        if (!present[k])
+            test_rbtree_insert(&arg->root->rbt_root, &arg->entries[2 * k + 1]);
+    }
+    rbtree_write_unlock(arg->root);
+    return NULL;
+}
+
+static void *test_seq_reader(void *p)
+{
+    struct test_seq_arg_t *arg = p;
+    struct test_node_t *entry;
+    int k;
+
+    while (!__atomic_load_n(&arg->stop, __ATOMIC_RELAXED)) {
+        k = rbtree_rand_r(&arg->seed) % TEST_SEQ_KEYS;
+        if (arg->use_lock > 0) {
+            pthread_mutex_lock(&arg->root->lock);
+            entry = test_rbtree_search(&arg->root->rbt_root, k);
+            pthread_mutex_unlock(&arg->root->lock);
+        } else
+            entry = test_rbtree_search_seq(arg->root, k);
+        if (entry ? entry->key != k : k % 2 == 0)
+            arg->errors++;
+        arg->lookups++;
+    }
+    return NULL;
+}
+
+// Lockless lookups while a writer rotates the tree non-stop
+void test_rbtree_seq(void)
+{
+    static struct test_node_t entries[TEST_SEQ_KEYS];
+    static struct k_rbtree_seq_root_t root;
+    struct test_seq_arg_t args[TEST_SEQ_READERS + 1];
+    pthread_t tids[TEST_SEQ_READERS + 1];
+    long lookups = 0, errors = 0;
+
+    printf("\nTesting lockless seq readers against a busy writer...\n");
+    rbtree_seq_init(&root);
+    for (int k = 0; k < TEST_SEQ_KEYS; k++) {
+        entries[k].key = k;
+        test_rbtree_insert(&root.rbt_root, &entries[k]);
+    }
+
+    for (int i = 0; i <= TEST_SEQ_READERS; i++) {
+        memset(&args[i], 0, sizeof(args[i]));
+        args[i].root = &root;
+        args[i].entries = entries;
+        args[i].use_lock = -1;          // Writer runs flat out
+        args[i].seed = 0x1234567ull * (i + 1);
+        pthread_create(&tids[i], NULL, i ? test_seq_reader : test_seq_writer, &args[i]);
+    }
+    usleep(300000);
+    for (int i = 0; i <= TEST_SEQ_READERS; i++)
+        __atomic_store_n(&args[i].stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i <= TEST_SEQ_READERS; i++) {
+        pthread_join(tids[i], NULL);
+        lookups += args[i].lookups;
+        errors += args[i].errors;
+    }
+
+    printf("%ld updates, %ld lookups, %ld wrong results, tree %s\n", args[0].updates, lookups, errors,
+           rbtree_valid(&root.rbt_root, TEST_SEQ_KEYS) ? "valid" : "INVALID");
+    pthread_mutex_destroy(&root.lock);
+}
+
+// Stored sizes against a recount, returns the subtree size or -1
+static long test_os_check(struct k_rbtree_node_t *node)
+{
+    long l, r;
+
+    if (!node)
+        return 0;
+    l = test_os_check(node->rbt_left);
+    r = test_os_check(node->rbt_right);
+    if (l < 0 || r < 0 || (size_t)(l + r + 1) != rbtree_size(node))
+        return -1;
+    return l + r + 1;
+}
+
+#define TEST_OS_KEYS        2048
+
+// Random inserts and erases on a size-augmented tree: sizes stay exact
+// and select/rank agree with a brute-force count
+void test_rbtree_order_stat(void)
+{
+    static struct test_os_node_t entries[TEST_OS_KEYS];
+    static char present[TEST_OS_KEYS];
+    struct k_rbtree_root_t root = {NULL};
+    struct test_os_node_t *entry;
+    size_t count = 0, below;
+    int errors = 0, k;
+
+    printf("\nTesting order statistics (subtree sizes)...\n");
+    memset(present, 0, sizeof(present));
+    for (long i = 0; i < 200000; i++) {
+        k = rbtree_rand() % TEST_OS_KEYS;
+        if (present[k]) {
+            test_os_erase_size(&root, &entries[k]);
+            count--;
+        } else {
+            entries[k].key = k;
+            test_os_insert_size(&root, &entries[k]);
+            count++;
+        }
+        present[k] = !present[k];
+
+        if (test_os_check(root.rbt_node) != (long)count)
+            errors++;
+        if (i % 1000 == 0) {
+            below = 0;
+            for (k = 0; k < TEST_OS_KEYS; k++) {
+                if (test_os_rank(&root, k) != below)
+                    errors++;
+                if (present[k]) {
+                    entry = test_os_select(&root, below);
+                    if (!entry || entry->key != k)
+                        errors++;
+                    below++;
+                }
+            }
+            if (test_os_select(&root, count) != NULL)
+                errors++;
+        }
+    }
+    printf("%zu entries left, %d errors\n", count, errors);
+}
+
+#define TEST_BTREE_KEYS     20000
+
+// Leaves on the chain; *empty counts those without keys
+static size_t test_btree_leaves(const struct k_btree_t *tree, size_t *empty)
+{
+    size_t leaves = 0;
+
+    *empty = 0;
+    for (struct k_btree_node_t *node = btree_leaf(tree, INT64_MIN); node; node = node->next) {
+        leaves++;
+        *empty += node->count == 0;
+    }
+    return leaves;
+}
+
+// Fill with sequential keys, erase all but every 100th, then the rest:
+// emptied leaves must leave the chain and the tree must end up empty
+static int test_btree_churn(void)
+{
+    struct k_btree_t tree = {NULL, 0};
+    size_t leaves, empty;
+    int errors = 0;
+
+    for (int64_t k = 0; k < TEST_BTREE_KEYS; k++)
+        errors += btree_insert(&tree, k, &tree) != 0;
+    for (int64_t k = 0; k < TEST_BTREE_KEYS; k++) {
+        if (k % 100)
+            errors += btree_erase(&tree, k) != 1;
+    }
+    leaves = test_btree_leaves(&tree, &empty);
+    errors += empty != 0 || leaves > tree.count;
+    printf("churn: %zu keys in %zu leaves\n", tree.count, leaves);
+
+    for (int64_t k = 0; k < TEST_BTREE_KEYS; k += 100)
+        errors += btree_erase(&tree, k) != 1;
+    errors += tree.count != 0 || tree.root != NULL;
+
+    errors += btree_insert(&tree, 1, &tree) != 0 || btree_search(&tree, 1) != &tree;
+    btree_destroy(&tree);
+    return errors;
+}
+
+// Random inserts, erases and lookups against a presence map, then an
+// in-order scan and lower_bound checks, plus the int64_t extremes, and
+// a churn that must give back emptied leaves
+void test_btree(void)
+{
+    static char present[TEST_BTREE_KEYS];
+    struct k_btree_t tree = {NULL, 0};
+    struct k_btree_iter_t it;
+    int64_t key, last, edge[] = {INT64_MIN, INT64_MIN + 1, -1, 0, INT64_MAX - 1, INT64_MAX};
+    size_t count = 0, seen = 0, empty;
+    int errors = 0, ret;
+
+    printf("\nTesting B+tree (%d keys per node, %s search)...\n", BTREE_KEYS,
+#if defined(__AVX2__)
+           "AVX2"
+#elif defined(__SSE4_2__)
+           "SSE4.2"
+#else
+           "scalar"
+#endif
+           );
+    memset(present, 0, sizeof(present));
+    for (long i = 0; i < 300000; i++) {
+        int k = rbtree_rand() % TEST_BTREE_KEYS;
+
+        key = (int64_t)k * 3 - TEST_BTREE_KEYS;     // Negative keys too
+        if (rbtree_rand() % 3) {
+            ret = btree_insert(&tree, key, &present[k]);
+            errors += ret != (present[k] ? 1 : 0);
+            count += !present[k];
+            present[k] = 1;
+        } else {
+            errors += btree_erase(&tree, key) != present[k];
+            count -= present[k];
+            present[k] = 0;
+        }
+        k = rbtree_rand() % TEST_BTREE_KEYS;
+        errors += (btree_search(&tree, (int64_t)k * 3 - TEST_BTREE_KEYS) != NULL) != present[k];
+    }
+    errors += tree.count != count;
+
+    last = INT64_MIN;
+    for (ret = btree_first(&tree, &it); ret; ret = btree_next(&it)) {
+        key = it.node->keys[it.pos];
+        errors += (seen && key <= last) || it.node->values[it.pos] != &present[(key + TEST_BTREE_KEYS) / 3];
+        last = key;
+        seen++;
+    }
+    errors += seen != count;
+    test_btree_leaves(&tree, &empty);
+    errors += empty != 0;
+
+    for (int k = 0; k < TEST_BTREE_KEYS; k += 97) {
+        int j = k;
+
+        while (j < TEST_BTREE_KEYS && !present[j])
+            j++;
+        ret = btree_lower_bound(&tree, (int64_t)k * 3 - TEST_BTREE_KEYS - 1, &it);
+        errors += j < TEST_BTREE_KEYS ? !ret || it.node->keys[it.pos] != (int64_t)j * 3 - TEST_BTREE_KEYS : ret;
+    }
+
+    for (size_t i = 0; i < sizeof(edge) / sizeof(edge[0]); i++)
+        errors += btree_insert(&tree, edge[i], &edge[i]) != 0;
+    for (size_t i = 0; i < sizeof(edge) / sizeof(edge[0]); i++)
+        errors += btree_search(&tree, edge[i]) != &edge[i];
+    errors += !btree_first(&tree, &it) || it.node->keys[it.pos] != INT64_MIN;
+
+    errors += test_btree_churn();
+    printf("%zu keys, %zu scanned, %d errors\n", tree.count, seen, errors);
+    btree_destroy(&tree);
+}
+
+#define TEST_DUP_KEYS       512
+#define TEST_DUP_ENTRIES    8192
+
+static int test_depth(const struct k_rbtree_node_t *node)
+{
+    int l, r;
+
+    if (!node)
+        return 0;
+    l = test_depth(node->rbt_left);
+    r = test_depth(node->rbt_right);
+    return 1 + (l > r ? l : r);
+}
+
+// Walk a multimap: linked keys strictly increase, each duplicate chain
+// holds the same key in insertion order. Returns the number of entries,
+// or -1 on a violation.
+static long test_multi_check(struct k_rbtree_root_t *root, size_t *keys)
+{
+    struct test_multi_t *entry, *dup;
+    long count = 0, prev_key = (long)INT32_MIN - 1;
+
+    *keys = 0;
+    for (struct k_rbtree_node_t *node = rbtree_first(root); node; node = rbtree_next(node)) {
+        entry = K_RBTREE_ENTRY(node, struct test_multi_t, node);
+        if (entry->key <= prev_key || K_RBTREE_EMPTY_NODE(node))
+            return -1;
+        prev_key = entry->key;
+        (*keys)++;
+        count++;
+        for (dup = test_multi_next_dup(entry); dup; dup = test_multi_next_dup(dup)) {
+            if (dup->key != entry->key || dup->seq <= entry->seq)
+                return -1;
+            entry = dup;
+            count++;
+        }
+    }
+    return count;
+}
+
+// insert_or_find against a presence map, then a multimap filled with
+// heavy duplicates and drained in random order
+void test_rbtree_dups(void)
+{
+    static struct test_node_t nodes[TEST_DUP_ENTRIES];
+    static struct test_multi_t multi[TEST_DUP_ENTRIES];
+    static struct test_multi_t *oldest[TEST_DUP_KEYS];
+    static int order[TEST_DUP_ENTRIES];
+    static char present[TEST_DUP_KEYS];
+    struct k_rbtree_root_t root = {NULL};
+    struct test_node_t *found;
+    struct test_multi_t *entry;
+    size_t distinct = 0, keys;
+    long left = TEST_DUP_ENTRIES;
+    int errors = 0, k, tmp;
+
+    printf("\nTesting duplicate keys (insert_or_find, multimap)...\n");
+    memset(present, 0, sizeof(present));
+    for (int i = 0; i < TEST_DUP_ENTRIES; i++) {
+        nodes[i].key = rbtree_rand() % TEST_DUP_KEYS;
+        found = test_rbtree_insert_or_find(&root, &nodes[i]);
+        if (present[nodes[i].key]) {
+            if (!found || found->key != nodes[i].key || found == &nodes[i])
+                errors++;
+        } else {
+            if (found)
+                errors++;
+            present[nodes[i].key] = 1;
+            distinct++;
+        }
+    }
+    if (!rbtree_valid(&root, distinct))
+        errors++;
+    printf("insert_or_find: %d inserts, %zu distinct, %d errors\n", TEST_DUP_ENTRIES, distinct, errors);
+
+    root.rbt_node = NULL;
+    for (int i = 0; i < TEST_DUP_ENTRIES; i++) {
+        multi[i].key = rbtree_rand() % TEST_DUP_KEYS;
+        multi[i].seq = i;
+        test_multi_insert_multi(&root, &multi[i]);
+        order[i] = i;
+    }
+    if (test_multi_check(&root, &keys) != TEST_DUP_ENTRIES)
+        errors++;
+    printf("multimap: %d entries on %zu tree nodes, depth %d\n", TEST_DUP_ENTRIES, keys,
+           test_depth(root.rbt_node));
+
+    // Erase in random order, hitting both linked entries and queued
+    // duplicates; search must keep returning the oldest survivor
+    for (int i = TEST_DUP_ENTRIES - 1; i > 0; i--) {
+        k = rbtree_rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[k];
+        order[k] = tmp;
+    }
+    for (int i = 0; i < TEST_DUP_ENTRIES; i++) {
+        test_multi_erase_multi(&root, &multi[order[i]]);
+        left--;
+        if (i % 256 == 0 || left == 0) {
+            memset(oldest, 0, sizeof(oldest));
+            for (int j = i + 1; j < TEST_DUP_ENTRIES; j++) {
+                entry = &multi[order[j]];
+                if (!oldest[entry->key] || entry->seq < oldest[entry->key]->seq)
+                    oldest[entry->key] = entry;
+            }
+            for (k = 0; k < TEST_DUP_KEYS; k++) {
+                if (test_multi_search(&root, k) != oldest[k])
+                    errors++;
+            }
+            if (test_multi_check(&root, &keys) != left)
+                errors++;
+        }
+    }
+    printf("multimap drained, %zu tree nodes left, %d errors\n", keys, errors);
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#define BENCH_TIMER_OPS     5000000
+#define BENCH_TIMER_PEEKS   4           // Expiry checks per fired timer
+
+// Timer-like workload: check the earliest deadline a few times per tick,
+// then fire it and re-arm it a random delay later. Plain root walks
+// rbt_left for every peek and pop; the cached root does not.
+void bench_rbtree_cached(void)
+{
+    static const size_t sizes[] = {1000, 100000, 1000000};
+    struct test_node_t *nodes, *entry;
+    struct k_rbtree_node_t *node;
+    uint64_t start, plain_ns, cached_ns;
+    long sum = 0;
+
+    printf("\nBenchmark: timer workload, plain vs cached-leftmost root (%d fires, %d peeks each)\n",
+           BENCH_TIMER_OPS, BENCH_TIMER_PEEKS);
+    printf("----------------------------------------------------------------\n");
+    printf("%-10s %14s %14s %8s\n", "timers", "plain ns/op", "cached ns/op", "speedup");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        struct k_rbtree_root_t plain = {NULL};
+        struct k_rbtree_root_cached_t cached = {{NULL}, NULL};
+
+        nodes = malloc(sizes[s] * sizeof(*nodes));
+
+        rbtree_rand_state = 42;
+        for (size_t i = 0; i < sizes[s]; i++) {
+            nodes[i].key = rbtree_rand() % (sizes[s] * 4);
+            test_rbtree_insert(&plain, &nodes[i]);
+        }
+        start = bench_now_ns();
+        for (long i = 0; i < BENCH_TIMER_OPS; i++) {
+            for (int p = 0; p < BENCH_TIMER_PEEKS; p++) {
+                node = rbtree_first(&plain);
+                sum += TEST_ENTRY(node)->key;
+            }
+            rbtree_erase(node, &plain);
+            entry = TEST_ENTRY(node);
+            entry->key += 1 + rbtree_rand() % (sizes[s] * 4);
+            test_rbtree_insert(&plain, entry);
+        }
+        plain_ns = bench_now_ns() - start;
+
+        rbtree_rand_state = 42;
+        for (size_t i = 0; i < sizes[s]; i++) {
+            nodes[i].key = rbtree_rand() % (sizes[s] * 4);
+            test_rbtree_insert_cached(&cached, &nodes[i]);
+        }
+        start = bench_now_ns();
+        for (long i = 0; i < BENCH_TIMER_OPS; i++) {
+            for (int p = 0; p < BENCH_TIMER_PEEKS; p++) {
+                sum += TEST_ENTRY(K_RBTREE_FIRST_CACHED(&cached))->key;
+            }
+            entry = TEST_ENTRY(rbtree_pop_first_cached(&cached));
+            entry->key += 1 + rbtree_rand() % (sizes[s] * 4);
+            test_rbtree_insert_cached(&cached, entry);
+        }
+        cached_ns = bench_now_ns() - start;
+
+        printf("%-10zu %14.1f %14.1f %7.2fx\n", sizes[s], (double)plain_ns / BENCH_TIMER_OPS,
+               (double)cached_ns / BENCH_TIMER_OPS, (double)plain_ns / cached_ns);
+        free(nodes);
+    }
+    printf("(checksum %ld)\n", sum);
+}
+
+// Generic search through a comparator function pointer, the way a
+// non-generated API would do it
+typedef int (*bench_cmp_fn)(const void *key, const struct k_rbtree_node_t *node);
+
+static __attribute__((noinline)) struct k_rbtree_node_t *
+bench_search_fn(const struct k_rbtree_root_t *root, const void *key, bench_cmp_fn cmp)
+{
+    struct k_rbtree_node_t *node = root->rbt_node;
+    int c;
+
+    while (node) {
+        c = cmp(key, node);
+        if (c < 0)
+            node = node->rbt_left;
+        else if (c > 0)
+            node = node->rbt_right;
+        else
+            return node;
+    }
+    return NULL;
+}
+
+static int bench_cmp_id(const void *key, const struct k_rbtree_node_t *node)
+{
+    uint64_t id = *(const uint64_t *)key;
+
+    return K_RBTREE_CMP_NUM(id, K_RBTREE_ENTRY(node, struct test_obj_t, by_id)->id);
+}
+
+static int bench_cmp_name(const void *key, const struct k_rbtree_node_t *node)
+{
+    return strcmp(key, K_RBTREE_ENTRY(node, struct test_obj_t, by_name)->name);
+}
+
+#define BENCH_LOOKUP_KEYS   1000000
+#define BENCH_LOOKUP_OPS    5000000
+
+// Lookup throughput for 64-bit and string keys: generated search with the
+// comparator inlined vs the same descent through a function pointer
+void bench_rbtree_intrusive(void)
+{
+    struct test_obj_t *objs = malloc(BENCH_LOOKUP_KEYS * sizeof(*objs));
+    char *names = malloc(BENCH_LOOKUP_KEYS * 32);
+    uint32_t *order = malloc(BENCH_LOOKUP_OPS * sizeof(uint32_t));
+    struct k_rbtree_root_t ids = {NULL}, by_name = {NULL};
+    uint64_t start, gen_ns, fn_ns;
+    size_t found = 0;
+
+    printf("\nBenchmark: intrusive lookups, %d keys, %d random hits\n", BENCH_LOOKUP_KEYS, BENCH_LOOKUP_OPS);
+    printf("----------------------------------------------------------------\n");
+    printf("%-10s %16s %16s %8s\n", "key", "generated Mops/s", "fn ptr Mops/s", "speedup");
+
+    rbtree_rand_state = 7;
+    for (size_t i = 0; i < BENCH_LOOKUP_KEYS; i++) {
+        objs[i].id = ((uint64_t)rbtree_rand() << 32) | rbtree_rand();
+        objs[i].name = names + i * 32;
+        // Shared prefix so comparisons go past the first bytes
+        snprintf(names + i * 32, 32, "/dev/sensor/%016llx", (unsigned long long)objs[i].id);
+        test_obj_id_insert(&ids, &objs[i]);
+        test_obj_name_insert(&by_name, &objs[i]);
+    }
+    for (size_t i = 0; i < BENCH_LOOKUP_OPS; i++) {
+        order[i] = rbtree_rand() % BENCH_LOOKUP_KEYS;
+    }
+
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_LOOKUP_OPS; i++) {
+        found += test_obj_id_search(&ids, objs[order[i]].id) != NULL;
+    }
+    gen_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_LOOKUP_OPS; i++) {
+        found += bench_search_fn(&ids, &objs[order[i]].id, bench_cmp_id) != NULL;
+    }
+    fn_ns = bench_now_ns() - start;
+    printf("%-10s %16.2f %16.2f %7.2fx\n", "uint64_t", BENCH_LOOKUP_OPS * 1000.0 / gen_ns,
+           BENCH_LOOKUP_OPS * 1000.0 / fn_ns, (double)fn_ns / gen_ns);
+
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_LOOKUP_OPS; i++) {
+        found += test_obj_name_search(&by_name, objs[order[i]].name) != NULL;
+    }
+    gen_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_LOOKUP_OPS; i++) {
+        found += bench_search_fn(&by_name, objs[order[i]].name, bench_cmp_name) != NULL;
+    }
+    fn_ns = bench_now_ns() - start;
+    printf("%-10s %16.2f %16.2f %7.2fx\n", "string", BENCH_LOOKUP_OPS * 1000.0 / gen_ns,
+           BENCH_LOOKUP_OPS * 1000.0 / fn_ns, (double)fn_ns / gen_ns);
+    printf("(%zu of %d found)\n", found, 4 * BENCH_LOOKUP_OPS);
+
+    free(order);
+    free(names);
+    free(objs);
+}
+
+#define BENCH_POOL_KEYS     1000000
+
+static double bench_pool_walk(struct k_rbtree_root_t *root, long *sum)
+{
+    struct k_rbtree_node_t *node;
+    uint64_t start = bench_now_ns();
+
+    for (node = rbtree_first(root); node; node = rbtree_next(node))
+        *sum += TEST_ENTRY(node)->key;
+    return (double)(bench_now_ns() - start) / BENCH_POOL_KEYS;
+}
+
+// Insert, in-order walk and teardown with malloc'd entries vs the pool.
+// The tree is churned first (erase and re-insert half the keys) so entries
+// are recycled the way a long-lived tree would recycle them.
+void bench_rbtree_pool(void)
+{
+    struct test_node_t **entries = malloc(BENCH_POOL_KEYS * sizeof(*entries));
+    struct k_rbtree_pool_t pool;
+    uint64_t start;
+    double ins[2], walk[2], destroy[2];
+    long sum = 0;
+
+    printf("\nBenchmark: malloc vs node pool, %d entries\n", BENCH_POOL_KEYS);
+    printf("----------------------------------------------------------------\n");
+    rbtree_pool_init(&pool, sizeof(struct test_node_t));
+
+    for (int m = 0; m < 2; m++) {
+        struct k_rbtree_root_t root = {NULL};
+
+        rbtree_rand_state = 11;
+        start = bench_now_ns();
+        for (int i = 0; i < BENCH_POOL_KEYS; i++) {
+            entries[i] = m ? rbtree_pool_alloc(&pool) : malloc(sizeof(struct test_node_t));
+            entries[i]->key = rbtree_rand();
+            test_rbtree_insert(&root, entries[i]);
+        }
+        ins[m] = (double)(bench_now_ns() - start) / BENCH_POOL_KEYS;
+
+        for (int i = 0; i < BENCH_POOL_KEYS; i++) {
+            int j = rbtree_rand() % BENCH_POOL_KEYS;
+
+            if (i % 2)
+                continue;
+            rbtree_erase(&entries[j]->node, &root);
+            if (m)
+                rbtree_pool_free(&pool, entries[j]);
+            else
+                free(entries[j]);
+            entries[j] = m ? rbtree_pool_alloc(&pool) : malloc(sizeof(struct test_node_t));
+            entries[j]->key = rbtree_rand();
+            test_rbtree_insert(&root, entries[j]);
+        }
+        walk[m] = bench_pool_walk(&root, &sum);
+
+        start = bench_now_ns();
+        if (m) {
+            rbtree_pool_destroy(&pool);
+        } else {
+            for (int i = 0; i < BENCH_POOL_KEYS; i++)
+                free(entries[i]);
+        }
+        destroy[m] = (double)(bench_now_ns() - start) / BENCH_POOL_KEYS;
+    }
+
+    printf("%-8s %14s %14s %14s\n", "", "insert ns/op", "walk ns/node", "free ns/node");
+    printf("%-8s %14.1f %14.2f %14.2f\n", "malloc", ins[0], walk[0], destroy[0]);
+    printf("%-8s %14.1f %14.2f %14.2f\n", "pool", ins[1], walk[1], destroy[1]);
+    printf("(checksum %ld)\n", sum);
+    free(entries);
+}
+
+#ifndef BENCH_BUILD_KEYS
+#define BENCH_BUILD_KEYS    10000000    // -DBENCH_BUILD_KEYS=50000000 for the full snapshot size
+#endif
+
+// Loading a sorted snapshot: one insert_key-style insert per key vs the
+// linear bulk build
+void bench_rbtree_build(void)
+{
+    struct test_node_t *entries = malloc((size_t)BENCH_BUILD_KEYS * sizeof(*entries));
+    struct k_rbtree_node_t **nodes = malloc((size_t)BENCH_BUILD_KEYS * sizeof(*nodes));
+    struct k_rbtree_root_t root = {NULL};
+    uint64_t start, ins_ns, build_ns;
+
+    printf("\nBenchmark: loading %d sorted keys\n", BENCH_BUILD_KEYS);
+    printf("----------------------------------------------------------------\n");
+
+    for (size_t i = 0; i < BENCH_BUILD_KEYS; i++) {
+        entries[i].key = (int)i;
+        nodes[i] = &entries[i].node;
+    }
+
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_BUILD_KEYS; i++)
+        test_rbtree_insert(&root, &entries[i]);
+    ins_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    rbtree_build_sorted(&root, nodes, BENCH_BUILD_KEYS);
+    build_ns = bench_now_ns() - start;
+
+    printf("one insert per key: %8.1f ms\n", ins_ns / 1e6);
+    printf("rbtree_build_sorted:%8.1f ms (%.1fx)\n", build_ns / 1e6, (double)ins_ns / build_ns);
+
+    free(nodes);
+    free(entries);
+}
+
+#define BENCH_RANGE_KEYS    1000000
+#define BENCH_RANGE_QUERIES 100000
+#define BENCH_RANGE_SPAN    200         // Keys are even, about 100 hits per query
+
+static int bench_range_visit(struct k_rbtree_node_t *node, void *arg)
+{
+    *(long *)arg += TEST_ENTRY(node)->key;
+    return 0;
+}
+
+// [a, a + span) queries: range scan vs a filtered full in-order walk
+void bench_rbtree_range(void)
+{
+    struct test_node_t *entries = malloc(BENCH_RANGE_KEYS * sizeof(*entries));
+    struct k_rbtree_node_t **nodes = malloc(BENCH_RANGE_KEYS * sizeof(*nodes));
+    struct k_rbtree_root_t root;
+    struct k_rbtree_node_t *node;
+    uint64_t start, scan_ns, walk_ns;
+    long sum_scan = 0, sum_walk = 0;
+    int lo, walks = 100;
+
+    printf("\nBenchmark: range queries over %d keys, ~%d hits each\n", BENCH_RANGE_KEYS, BENCH_RANGE_SPAN / 2);
+    printf("----------------------------------------------------------------\n");
+    for (int i = 0; i < BENCH_RANGE_KEYS; i++) {
+        entries[i].key = i * 2;
+        nodes[i] = &entries[i].node;
+    }
+    rbtree_build_sorted(&root, nodes, BENCH_RANGE_KEYS);
+
+    rbtree_rand_state = 5;
+    start = bench_now_ns();
+    for (int q = 0; q < BENCH_RANGE_QUERIES; q++) {
+        lo = rbtree_rand() % (2 * BENCH_RANGE_KEYS);
+        test_rbtree_range(&root, lo, lo + BENCH_RANGE_SPAN, bench_range_visit, &sum_scan);
+    }
+    scan_ns = bench_now_ns() - start;
+
+    // Full walks are slow, time a few and scale
+    rbtree_rand_state = 5;
+    start = bench_now_ns();
+    for (int q = 0; q < walks; q++) {
+        lo = rbtree_rand() % (2 * BENCH_RANGE_KEYS);
+        for (node = rbtree_first(&root); node; node = rbtree_next(node)) {
+            int key = TEST_ENTRY(node)->key;
+
+            if (key >= lo && key < lo + BENCH_RANGE_SPAN)
+                sum_walk += key;
+        }
+    }
+    walk_ns = bench_now_ns() - start;
+
+    printf("range scan:      %10.2f us/query\n", scan_ns / 1e3 / BENCH_RANGE_QUERIES);
+    printf("full walk:       %10.2f us/query (%.0fx)\n", walk_ns / 1e3 / walks,
+           (double)walk_ns / walks / ((double)scan_ns / BENCH_RANGE_QUERIES));
+    printf("(checksum %ld %ld)\n", sum_scan, sum_walk);
+
+    free(nodes);
+    free(entries);
+}
+
+#define BENCH_SEQ_MS        300
+
+// Read scaling with one writer doing 10k updates/s: readers serialized on
+// the tree lock vs lockless seq readers
+void bench_rbtree_seq(void)
+{
+    static struct test_node_t entries[TEST_SEQ_KEYS];
+    static const int readers[] = {1, 2, 4, 8};
+    struct k_rbtree_seq_root_t root;
+    struct test_seq_arg_t args[9];
+    pthread_t tids[9];
+    double rate[2];
+
+    printf("\nBenchmark: read scaling, %d keys, one writer at 10k updates/s (%ld cpus)\n",
+           TEST_SEQ_KEYS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("----------------------------------------------------------------\n");
+    printf("%-8s %16s %16s\n", "readers", "locked Mops/s", "seq Mops/s");
+
+    for (size_t r = 0; r < sizeof(readers) / sizeof(readers[0]); r++) {
+        for (int mode = 0; mode < 2; mode++) {
+            long lookups = 0;
+
+            rbtree_seq_init(&root);
+            for (int k = 0; k < TEST_SEQ_KEYS; k++) {
+                entries[k].key = k;
+                test_rbtree_insert(&root.rbt_root, &entries[k]);
+            }
+            for (int i = 0; i <= readers[r]; i++) {
+                memset(&args[i], 0, sizeof(args[i]));
+                args[i].root = &root;
+                args[i].entries = entries;
+                args[i].use_lock = !mode;
+                args[i].seed = 0x9876543ull * (i + 1);
+                pthread_create(&tids[i], NULL, i ? test_seq_reader : test_seq_writer, &args[i]);
+            }
+            usleep(BENCH_SEQ_MS * 1000);
+            for (int i = 0; i <= readers[r]; i++)
+                __atomic_store_n(&args[i].stop, 1, __ATOMIC_RELAXED);
+            for (int i = 0; i <= readers[r]; i++) {
+                pthread_join(tids[i], NULL);
+                lookups += args[i].lookups;
+            }
+            rate[mode] = lookups / (BENCH_SEQ_MS * 1000.0);
+            pthread_mutex_destroy(&root.lock);
+        }
+        printf("%-8d %16.2f %16.2f\n", readers[r], rate[0], rate[1]);
+    }
+}
+
+#define BENCH_OS_KEYS       1000000
+#define BENCH_OS_QUERIES    1000000
+
+// Cost of maintaining sizes on insert, and select/rank against walking
+// the tree in order
+void bench_rbtree_order_stat(void)
+{
+    struct test_os_node_t *os = malloc(BENCH_OS_KEYS * sizeof(*os));
+    struct test_node_t *plain = malloc(BENCH_OS_KEYS * sizeof(*plain));
+    struct k_rbtree_root_t os_root = {NULL}, plain_root = {NULL};
+    struct k_rbtree_node_t *node;
+    uint64_t start, plain_ns, os_ns, sel_ns, rank_ns, walk_ns;
+    size_t sum = 0;
+    int walks = 20;
+
+    printf("\nBenchmark: order statistics, %d keys\n", BENCH_OS_KEYS);
+    printf("----------------------------------------------------------------\n");
+
+    rbtree_rand_state = 3;
+    for (int i = 0; i < BENCH_OS_KEYS; i++)
+        plain[i].key = os[i].key = rbtree_rand() & 0x7fffffff;
+
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_OS_KEYS; i++)
+        test_rbtree_insert(&plain_root, &plain[i]);
+    plain_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_OS_KEYS; i++)
+        test_os_insert_size(&os_root, &os[i]);
+    os_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_OS_QUERIES; i++)
+        sum += test_os_select(&os_root, rbtree_rand() % BENCH_OS_KEYS)->key;
+    sel_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_OS_QUERIES; i++)
+        sum += test_os_rank(&os_root, rbtree_rand() & 0x7fffffff);
+    rank_ns = bench_now_ns() - start;
+
+    // Baseline: rank by counting in order up to the key
+    start = bench_now_ns();
+    for (int i = 0; i < walks; i++) {
+        int key = rbtree_rand() & 0x7fffffff;
+
+        for (node = rbtree_first(&plain_root); node && TEST_ENTRY(node)->key < key; node = rbtree_next(node))
+            sum++;
+    }
+    walk_ns = bench_now_ns() - start;
+
+    printf("insert, plain:          %10.1f ns\n", (double)plain_ns / BENCH_OS_KEYS);
+    printf("insert, with sizes:     %10.1f ns\n", (double)os_ns / BENCH_OS_KEYS);
+    printf("select(k):              %10.1f ns\n", (double)sel_ns / BENCH_OS_QUERIES);
+    printf("rank(key):              %10.1f ns\n", (double)rank_ns / BENCH_OS_QUERIES);
+    printf("rank by in-order walk:  %10.1f ns\n", (double)walk_ns / walks);
+    printf("(checksum %zu)\n", sum);
+
+    free(plain);
+    free(os);
+}
+
+// rbtree entry with the same int64_t key and value as the B+tree
+struct bench_kv_t {
+    int64_t key;
+    void *value;
+    struct k_rbtree_node_t node;
+};
+
+K_RBTREE_DEFINE(bench_kv, struct bench_kv_t, node, int64_t, key, K_RBTREE_CMP_NUM)
+
+// Distinct pseudo-random keys: splitmix64 is a bijection on 64 bits
+static int64_t bench_key(uint64_t i)
+{
+    uint64_t z = i + 0x9e3779b97f4a7c15ull;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (int64_t)(z ^ (z >> 31));
+}
+
+#define BENCH_BTREE_LOOKUPS 2000000
+#define BENCH_BTREE_MIN_OPS 1000000     // Small trees are rebuilt and rescanned to reach this
+
+// rbtree vs B+tree at one size: random-order insert, random hits, full
+// in-order scan, all per key
+static void bench_btree_size(size_t n)
+{
+    struct bench_kv_t *kv = malloc(n * sizeof(*kv));
+    struct k_rbtree_root_t root;
+    struct k_btree_t tree = {NULL, 0};
+    struct k_btree_iter_t it;
+    struct k_rbtree_node_t *node;
+    size_t reps = n >= BENCH_BTREE_MIN_OPS ? 1 : BENCH_BTREE_MIN_OPS / n;
+    uint64_t start, t[2][3];
+    int64_t sum = 0;
+    uint32_t *order = malloc(BENCH_BTREE_LOOKUPS * sizeof(uint32_t));
+
+    if (!kv || !order) {
+        printf("%-10zu (out of memory)\n", n);
+        free(kv);
+        free(order);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        kv[i].key = bench_key(i);
+        kv[i].value = &kv[i];
+    }
+    for (size_t i = 0; i < BENCH_BTREE_LOOKUPS; i++)
+        order[i] = rbtree_rand() % n;
+
+    start = bench_now_ns();
+    for (size_t r = 0; r < reps; r++) {
+        root.rbt_node = NULL;
+        for (size_t i = 0; i < n; i++)
+            bench_kv_insert(&root, &kv[i]);
+    }
+    t[0][0] = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (size_t r = 0; r < reps; r++) {
+        btree_destroy(&tree);
+        for (size_t i = 0; i < n; i++)
+            btree_insert(&tree, kv[i].key, kv[i].value);
+    }
+    t[1][0] = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_BTREE_LOOKUPS; i++)
+        sum += bench_kv_search(&root, kv[order[i]].key)->key;
+    t[0][1] = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (size_t i = 0; i < BENCH_BTREE_LOOKUPS; i++)
+        sum += ((struct bench_kv_t *)btree_search(&tree, kv[order[i]].key))->key;
+    t[1][1] = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (size_t r = 0; r < reps; r++) {
+        for (node = rbtree_first(&root); node; node = rbtree_next(node))
+            sum += K_RBTREE_ENTRY(node, struct bench_kv_t, node)->key;
+    }
+    t[0][2] = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (size_t r = 0; r < reps; r++) {
+        for (int ok = btree_first(&tree, &it); ok; ok = btree_next(&it))
+            sum += it.node->keys[it.pos];
+    }
+    t[1][2] = bench_now_ns() - start;
+
+    for (int e = 0; e < 2; e++) {
+        printf("%-10zu %-7s %12.1f %12.1f %12.2f\n", n, e ? "btree" : "rbtree",
+               (double)t[e][0] / (n * reps), (double)t[e][1] / BENCH_BTREE_LOOKUPS,
+               (double)t[e][2] / (n * reps));
+    }
+    if (sum == 42)
+        printf("(checksum)\n");
+
+    btree_destroy(&tree);
+    free(order);
+    free(kv);
+}
+
+// Build with -mavx2 (or -march=native) for the SIMD node search;
+// -DBENCH_BTREE_HUGE adds the 100M-key run (about 8 GB)
+void bench_btree(void)
+{
+    printf("\nBenchmark: rbtree vs B+tree, ns per key\n");
+    printf("----------------------------------------------------------------\n");
+    printf("%-10s %-7s %12s %12s %12s\n", "keys", "engine", "insert", "lookup", "scan");
+    bench_btree_size(1000);
+    bench_btree_size(1000000);
+#ifdef BENCH_BTREE_HUGE
+    bench_btree_size(100000000);
+#endif
+}
+
+#define BENCH_DUP_ENTRIES   1000000
+#define BENCH_DUP_KEYS      1000
+#define BENCH_DUP_RANGE     (1 << 20)
+
+// Unique-key loads with a search before every insert against
+// insert_or_find, then a duplicate-heavy load with equal keys sent right
+// against the multimap
+void bench_rbtree_dups(void)
+{
+    struct test_node_t *nodes = malloc(BENCH_DUP_ENTRIES * sizeof(*nodes));
+    struct test_multi_t *multi = malloc(BENCH_DUP_ENTRIES * sizeof(*multi));
+    struct k_rbtree_root_t root = {NULL}, multi_root = {NULL};
+    uint64_t start, two_ns, one_ns, plain_ns, multi_ns, plain_find_ns, multi_find_ns;
+    size_t hits = 0, sum = 0;
+
+    printf("\nBenchmark: duplicate keys, %d entries\n", BENCH_DUP_ENTRIES);
+    printf("----------------------------------------------------------------\n");
+
+    rbtree_rand_state = 5;
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++)
+        nodes[i].key = rbtree_rand() % BENCH_DUP_RANGE;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++) {
+        if (test_rbtree_search(&root, nodes[i].key))
+            hits++;
+        else
+            test_rbtree_insert(&root, &nodes[i]);
+    }
+    two_ns = bench_now_ns() - start;
+    root.rbt_node = NULL;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++) {
+        if (test_rbtree_insert_or_find(&root, &nodes[i]))
+            hits++;
+    }
+    one_ns = bench_now_ns() - start;
+    printf("unique keys, %zu repeats in [0, %d):\n", hits / 2, BENCH_DUP_RANGE);
+    printf("  search + insert:      %8.1f ns\n", (double)two_ns / BENCH_DUP_ENTRIES);
+    printf("  insert_or_find:       %8.1f ns\n", (double)one_ns / BENCH_DUP_ENTRIES);
+
+    root.rbt_node = NULL;
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++) {
+        nodes[i].key = multi[i].key = rbtree_rand() % BENCH_DUP_KEYS;
+        multi[i].seq = i;
+    }
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++)
+        test_rbtree_insert(&root, &nodes[i]);
+    plain_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++)
+        test_multi_insert_multi(&multi_root, &multi[i]);
+    multi_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++)
+        sum += test_rbtree_search(&root, rbtree_rand() % BENCH_DUP_KEYS)->key;
+    plain_find_ns = bench_now_ns() - start;
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_DUP_ENTRIES; i++)
+        sum += test_multi_search(&multi_root, rbtree_rand() % BENCH_DUP_KEYS)->key;
+    multi_find_ns = bench_now_ns() - start;
+
+    printf("%d distinct keys:      %8s %8s %8s\n", BENCH_DUP_KEYS, "depth", "insert", "search");
+    printf("  duplicates in tree:   %8d %8.1f %8.1f ns\n", test_depth(root.rbt_node),
+           (double)plain_ns / BENCH_DUP_ENTRIES, (double)plain_find_ns / BENCH_DUP_ENTRIES);
+    printf("  multimap:             %8d %8.1f %8.1f ns\n", test_depth(multi_root.rbt_node),
+           (double)multi_ns / BENCH_DUP_ENTRIES, (double)multi_find_ns / BENCH_DUP_ENTRIES);
+    printf("(checksum %zu)\n", sum);
+
+    free(multi);
+    free(nodes);
+}
+
+int main(int argc, char *argv[])
+{
+    struct k_rbtree_root_t root = {NULL};
+
+    printf("Inserting numbers into Red-Black Tree...\n");
+    
+    // Test inserting some numbers
+    insert_key(&root, 10);
+    insert_key(&root, 5);
+    insert_key(&root, 15);
+    insert_key(&root, 3);
+    insert_key(&root, 7);
+    insert_key(&root, 12);
+    insert_key(&root, 18);
+
+    printf("\nInorder traversal of the tree (with colors):\n");
+    printf("Format: number(color) where R=Red, B=Black\n");
+    print_inorder(&root);
+    printf("\n");
+
+    printf("\nErasing 5 and 15...\n");
+    struct test_node_t *entry = test_rbtree_search(&root, 5);
+    rbtree_erase(&entry->node, &root);
+    free(entry);
+    entry = test_rbtree_search(&root, 15);
+    rbtree_erase(&entry->node, &root);
+    free(entry);
+    print_inorder(&root);
+    printf("\n");
+
+    struct k_rbtree_node_t *pos, *n;
+    K_RBTREE_POSTORDER_FOR_EACH_SAFE(pos, n, &root)
+        free(TEST_ENTRY(pos));
+
+    // Full 10M-op stress run only on request: ./rbtree_test stress
+    if (argc > 1 && strcmp(argv[1], "stress") == 0)
+        test_rbtree_stress(RBTREE_STRESS_OPS);
+    else
+        test_rbtree_stress(200000);
+    test_rbtree_cached();
+    test_rbtree_intrusive();
+    test_rbtree_pool();
+    test_rbtree_build();
+    test_rbtree_iter();
+    test_rbtree_seq();
+    test_rbtree_order_stat();
+    test_btree();
+    test_rbtree_dups();
+
+    // Benchmarks only run on request: ./rbtree_test bench
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench_rbtree_cached();
+        bench_rbtree_intrusive();
+        bench_rbtree_pool();
+        bench_rbtree_build();
+        bench_rbtree_range();
+        bench_rbtree_seq();
+        bench_rbtree_order_stat();
+        bench_btree();
+        bench_rbtree_dups();
+    }
 
     return 0;
 }
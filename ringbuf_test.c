@@ -1,19 +1,36 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Return status codes
 #define RHINO_SUCCESS        0
 #define RHINO_RINGBUF_FULL  1
 #define RHINO_INV_PARAM     2
+#define RHINO_NO_MEM        3
 
 // Ring buffer types
 #define RINGBUF_TYPE_DYN    0    // Dynamic size items
 #define RINGBUF_TYPE_FIX    1    // Fixed size items
 
+// Ring buffer flags
+#define RINGBUF_FLAG_MIRROR 0x01 // Pages mapped twice back to back
+#define RINGBUF_FLAG_ALLOC  0x02 // Backing owned by the ring buffer
+#define RINGBUF_FLAG_VARINT 0x04 // LEB128 length headers for DYN records
+
 #define RING_BUF_LEN sizeof(size_t)
 
+#define RINGBUF_VARINT_MAX  5    // LEB128 bytes for a length below (uint32_t)-1
+
+#define RINGBUF_CACHE_LINE  64
+
 typedef int kstat_t;
 
 // Ring buffer structure
@@ -25,6 +42,9 @@ typedef struct {
     size_t  freesize;      // Available space in buffer
     size_t  type;          // Buffer type (FIX/DYN)
     size_t  blk_size;      // Block size for fixed type
+    uint8_t *resv;         // Record reserved by ringbuf_reserve
+    size_t  resv_len;      // Payload length reserved
+    size_t  flags;         // RINGBUF_FLAG_*
 } k_ringbuf_t;
 
 // Initialize ring buffer
@@ -37,10 +57,210 @@ kstat_t ringbuf_init(k_ringbuf_t *p_ringbuf, void *buf, size_t len, size_t type,
     p_ringbuf->head = p_ringbuf->buf;
     p_ringbuf->tail = p_ringbuf->buf;
     p_ringbuf->freesize = len;
+    p_ringbuf->resv = NULL;
+    p_ringbuf->resv_len = 0;
+    p_ringbuf->flags = 0;
     
     return RHINO_SUCCESS;
 }
 
+// Check if ring buffer is empty
+uint8_t ringbuf_is_empty(k_ringbuf_t *p_ringbuf)
+{
+    return (p_ringbuf->freesize == (size_t)(p_ringbuf->end - p_ringbuf->buf));
+}
+
+// Map len bytes of a memfd twice, back to back, so that [buf, buf + 2 * len)
+// shows the same data twice and anything starting before end is contiguous
+static uint8_t *ringbuf_mirror_map(size_t len)
+{
+    uint8_t *base;
+    int fd;
+
+    fd = memfd_create("k_ringbuf", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (ftruncate(fd, len) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Reserve the whole window first so nothing can land in the second half
+    base = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * len);
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    return base;
+}
+
+// Initialize ring buffer on a plain allocation, the fallback backing of
+// ringbuf_init_mirror. A FIX buffer only wraps its tail at end, so len is
+// rounded down to a whole number of blocks.
+static kstat_t ringbuf_init_alloc(k_ringbuf_t *p_ringbuf, size_t len, size_t type, size_t block_size)
+{
+    uint8_t *buf;
+
+    if (type == RINGBUF_TYPE_FIX) {
+        if (block_size == 0u || len < block_size) {
+            return RHINO_INV_PARAM;
+        }
+        len -= len % block_size;
+    }
+
+    buf = malloc(len);
+    if (buf == NULL) {
+        return RHINO_NO_MEM;
+    }
+
+    ringbuf_init(p_ringbuf, buf, len, type, block_size);
+    p_ringbuf->flags = RINGBUF_FLAG_ALLOC;
+    return RHINO_SUCCESS;
+}
+
+// Initialize ring buffer on a mirrored mapping. len is rounded up to the
+// page size. If the mapping cannot be set up, the buffer falls back to a
+// plain allocation and the split-copy paths.
+kstat_t ringbuf_init_mirror(k_ringbuf_t *p_ringbuf, size_t len, size_t type, size_t block_size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t *buf;
+
+    if (len == 0u || (type == RINGBUF_TYPE_FIX && block_size == 0u)) {
+        return RHINO_INV_PARAM;
+    }
+
+    len = (len + page - 1) & ~(page - 1);
+
+    buf = ringbuf_mirror_map(len);
+    if (buf != NULL) {
+        ringbuf_init(p_ringbuf, buf, len, type, block_size);
+        p_ringbuf->flags = RINGBUF_FLAG_MIRROR | RINGBUF_FLAG_ALLOC;
+        return RHINO_SUCCESS;
+    }
+
+    return ringbuf_init_alloc(p_ringbuf, len, type, block_size);
+}
+
+// Release backing allocated by ringbuf_init_mirror
+kstat_t ringbuf_deinit(k_ringbuf_t *p_ringbuf)
+{
+    size_t len = p_ringbuf->end - p_ringbuf->buf;
+
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        munmap(p_ringbuf->buf, 2 * len);
+    } else if (p_ringbuf->flags & RINGBUF_FLAG_ALLOC) {
+        free(p_ringbuf->buf);
+    }
+
+    p_ringbuf->flags = 0;
+    return RHINO_SUCCESS;
+}
+
+// Switch an empty DYN buffer to LEB128 length headers: 1 byte for records
+// up to 127 bytes, 2 up to 16383, at most RINGBUF_VARINT_MAX
+kstat_t ringbuf_set_varint(k_ringbuf_t *p_ringbuf)
+{
+    if (p_ringbuf->type != RINGBUF_TYPE_DYN || !ringbuf_is_empty(p_ringbuf)) {
+        return RHINO_INV_PARAM;
+    }
+
+    p_ringbuf->flags |= RINGBUF_FLAG_VARINT;
+    return RHINO_SUCCESS;
+}
+
+// Header size for a record of len bytes
+static inline size_t ringbuf_hdr_bytes(k_ringbuf_t *p_ringbuf, size_t len)
+{
+    size_t len_bytes = 1;
+
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_VARINT)) {
+        return RING_BUF_LEN;
+    }
+
+    while (len >= 0x80) {
+        len >>= 7;
+        len_bytes++;
+    }
+
+    return len_bytes;
+}
+
+// Encode a record length header into c_len, returns the header size
+static inline size_t ringbuf_hdr_encode(k_ringbuf_t *p_ringbuf, uint8_t *c_len, size_t len)
+{
+    size_t len_bytes = 0;
+
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_VARINT)) {
+        memcpy(c_len, &len, RING_BUF_LEN);
+        return RING_BUF_LEN;
+    }
+
+    while (len >= 0x80) {
+        c_len[len_bytes++] = (uint8_t)(len | 0x80);
+        len >>= 7;
+    }
+    c_len[len_bytes++] = (uint8_t)len;
+
+    return len_bytes;
+}
+
+// Size of the header at p, following the wrap for split varints
+static inline size_t ringbuf_hdr_size(k_ringbuf_t *p_ringbuf, const uint8_t *p)
+{
+    size_t len_bytes = 0;
+
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_VARINT)) {
+        return RING_BUF_LEN;
+    }
+
+    do {
+        if (p == p_ringbuf->end) {
+            p = p_ringbuf->buf;
+        }
+        len_bytes++;
+    } while ((*p++ & 0x80) && len_bytes < RINGBUF_VARINT_MAX);
+
+    return len_bytes;
+}
+
+// Decode a record length header gathered into c_len
+static inline size_t ringbuf_hdr_decode(k_ringbuf_t *p_ringbuf, const uint8_t *c_len)
+{
+    size_t len = 0;
+
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_VARINT)) {
+        memcpy(&len, c_len, RING_BUF_LEN);
+        return len;
+    }
+
+    for (size_t i = 0; i < RINGBUF_VARINT_MAX; i++) {
+        len |= (size_t)(c_len[i] & 0x7f) << (7 * i);
+        if (!(c_len[i] & 0x80)) {
+            break;
+        }
+    }
+
+    return len;
+}
+
+// Fold a pointer that ran into the second mapping back into [buf, end)
+static inline uint8_t *ringbuf_mirror_fold(k_ringbuf_t *p_ringbuf, uint8_t *p)
+{
+    return (p >= p_ringbuf->end) ? p - (p_ringbuf->end - p_ringbuf->buf) : p;
+}
+
 // Push data into ring buffer
 kstat_t ringbuf_push(k_ringbuf_t *p_ringbuf, void *data, size_t len)
 {
@@ -60,18 +280,29 @@ kstat_t ringbuf_push(k_ringbuf_t *p_ringbuf, void *data, size_t len)
         memcpy(p_ringbuf->tail, data, p_ringbuf->blk_size);
         p_ringbuf->tail += p_ringbuf->blk_size;
         p_ringbuf->freesize -= p_ringbuf->blk_size;
+
+        if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+            p_ringbuf->tail = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->tail);
+        }
     } else {
         if ((len == 0u) || (len >= (uint32_t)-1)) {
             return RHINO_INV_PARAM;
         }
 
-        len_bytes = RING_BUF_LEN;
+        len_bytes = ringbuf_hdr_encode(p_ringbuf, c_len, len);
 
         if (p_ringbuf->freesize < (len_bytes + len)) {
             return RHINO_RINGBUF_FULL;
         }
 
-        memcpy(c_len, &len, RING_BUF_LEN);
+        if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+            // The second mapping makes every record contiguous
+            memcpy(p_ringbuf->tail, c_len, len_bytes);
+            memcpy(p_ringbuf->tail + len_bytes, data, len);
+            p_ringbuf->tail = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->tail + len_bytes + len);
+            p_ringbuf->freesize -= len_bytes + len;
+            return RHINO_SUCCESS;
+        }
 
         if (p_ringbuf->tail == p_ringbuf->end) {
             p_ringbuf->tail = p_ringbuf->buf;
@@ -84,6 +315,8 @@ kstat_t ringbuf_push(k_ringbuf_t *p_ringbuf, void *data, size_t len)
             len_bytes -= split_len;
             p_ringbuf->tail = p_ringbuf->buf;
             p_ringbuf->freesize -= split_len;
+        } else {
+            split_len = 0;
         }
 
         if (len_bytes > 0) {
@@ -122,7 +355,8 @@ kstat_t ringbuf_pop(k_ringbuf_t *p_ringbuf, void *pdata, size_t *plen)
     size_t split_len = 0;
     uint8_t c_len[RING_BUF_LEN] = {0};
 
-    if (p_ringbuf->head == p_ringbuf->tail) {
+    // head == tail is also the state of a completely full buffer
+    if (ringbuf_is_empty(p_ringbuf)) {
         return RHINO_RINGBUF_FULL;
     }
 
@@ -135,19 +369,37 @@ kstat_t ringbuf_pop(k_ringbuf_t *p_ringbuf, void *pdata, size_t *plen)
         p_ringbuf->head += p_ringbuf->blk_size;
         p_ringbuf->freesize += p_ringbuf->blk_size;
         *plen = p_ringbuf->blk_size;
-    } else {
-        len_bytes = RING_BUF_LEN;
 
+        if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+            p_ringbuf->head = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->head);
+        }
+    } else if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        len_bytes = ringbuf_hdr_size(p_ringbuf, p_ringbuf->head);
+        memcpy(c_len, p_ringbuf->head, len_bytes);
+        len = ringbuf_hdr_decode(p_ringbuf, c_len);
+        if (len == 0 || len >= (uint32_t)-1) {
+            return RHINO_INV_PARAM;
+        }
+
+        *plen = len;
+        memcpy(pdata, p_ringbuf->head + len_bytes, len);
+        p_ringbuf->head = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->head + len_bytes + len);
+        p_ringbuf->freesize += len_bytes + len;
+    } else {
         if (p_ringbuf->head == p_ringbuf->end) {
             p_ringbuf->head = p_ringbuf->buf;
         }
 
+        len_bytes = ringbuf_hdr_size(p_ringbuf, p_ringbuf->head);
+
         split_len = p_ringbuf->end - p_ringbuf->head;
         if (split_len < len_bytes && split_len > 0) {
             memcpy(&c_len[0], p_ringbuf->head, split_len);
             len_bytes -= split_len;
             p_ringbuf->head = p_ringbuf->buf;
             p_ringbuf->freesize += split_len;
+        } else {
+            split_len = 0;
         }
 
         if (len_bytes > 0) {
@@ -156,7 +408,7 @@ kstat_t ringbuf_pop(k_ringbuf_t *p_ringbuf, void *pdata, size_t *plen)
             p_ringbuf->freesize += len_bytes;
         }
 
-        memcpy(&len, c_len, RING_BUF_LEN);
+        len = ringbuf_hdr_decode(p_ringbuf, c_len);
         if (len == 0 || len >= (uint32_t)-1) {
             return RHINO_INV_PARAM;
         }
@@ -185,106 +437,1377 @@ kstat_t ringbuf_pop(k_ringbuf_t *p_ringbuf, void *pdata, size_t *plen)
     return RHINO_SUCCESS;
 }
 
-// Check if ring buffer is empty
-uint8_t ringbuf_is_empty(k_ringbuf_t *p_ringbuf)
-{
-    return (p_ringbuf->head == p_ringbuf->tail);
-}
-
 // Reset ring buffer
 kstat_t ringbuf_reset(k_ringbuf_t *p_ringbuf)
 {
     p_ringbuf->head = p_ringbuf->buf;
     p_ringbuf->tail = p_ringbuf->buf;
     p_ringbuf->freesize = p_ringbuf->end - p_ringbuf->buf;
+    p_ringbuf->resv = NULL;
     return RHINO_SUCCESS;
 }
 
-// Test function for fixed-size ring buffer
-void test_fixed_ringbuf(void)
+// Batched access.
+//
+// ringbuf_push_batch/ringbuf_pop_batch move several records per call: the
+// capacity check is done once for the whole batch, records are copied
+// through a local cursor that only compares against end, and head/tail and
+// freesize are published once at the end. For RINGBUF_TYPE_DYN each vector
+// is one record. For RINGBUF_TYPE_FIX each vector is a contiguous array of
+// blocks, so a batch of blocks costs at most two memcpys per vector. On pop,
+// len is the capacity of base and is updated to the bytes stored there.
+
+// Record vector for the batch calls
+typedef struct {
+    void   *base;          // Record data
+    size_t  len;           // Record length in bytes
+} k_ringbuf_vec_t;
+
+// Copy into the buffer at pos, splitting at end; returns the new pos
+static uint8_t *ringbuf_copy_in(k_ringbuf_t *p_ringbuf, uint8_t *pos, const void *data, size_t len)
 {
-    printf("\nTesting Fixed-Size Ring Buffer:\n");
-    printf("--------------------------------\n");
+    size_t split_len;
 
-    // Create buffer
-    const size_t BUF_SIZE = 20;
-    const size_t BLOCK_SIZE = 4;
-    uint8_t buffer[BUF_SIZE];
-    k_ringbuf_t ringbuf;
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_MIRROR)) {
+        if (pos == p_ringbuf->end) {
+            pos = p_ringbuf->buf;
+        }
 
-    // Initialize ring buffer
-    ringbuf_init(&ringbuf, buffer, BUF_SIZE, RINGBUF_TYPE_FIX, BLOCK_SIZE);
-    
-    // Test data
-    int test_data[] = {1234, 5678, 9012, 3456, 7890};
+        split_len = p_ringbuf->end - pos;
+        if (len > split_len) {
+            memcpy(pos, data, split_len);
+            data = (const uint8_t *)data + split_len;
+            len -= split_len;
+            pos = p_ringbuf->buf;
+        }
+    }
+
+    memcpy(pos, data, len);
+    return pos + len;
+}
+
+// Copy out of the buffer at pos, splitting at end; returns the new pos
+static uint8_t *ringbuf_copy_out(k_ringbuf_t *p_ringbuf, uint8_t *pos, void *pdata, size_t len)
+{
+    size_t split_len;
+
+    if (!(p_ringbuf->flags & RINGBUF_FLAG_MIRROR)) {
+        if (pos == p_ringbuf->end) {
+            pos = p_ringbuf->buf;
+        }
+
+        split_len = p_ringbuf->end - pos;
+        if (len > split_len) {
+            memcpy(pdata, pos, split_len);
+            pdata = (uint8_t *)pdata + split_len;
+            len -= split_len;
+            pos = p_ringbuf->buf;
+        }
+    }
+
+    memcpy(pdata, pos, len);
+    return pos + len;
+}
+
+// Push several records, *done is set to the number of records pushed
+kstat_t ringbuf_push_batch(k_ringbuf_t *p_ringbuf, k_ringbuf_vec_t *vec, size_t cnt, size_t *done)
+{
+    uint8_t c_len[RING_BUF_LEN] = {0};
+    uint8_t *pos = p_ringbuf->tail;
+    size_t used = 0;
+    size_t num = 0;
+    size_t blks;
     size_t len;
-    int read_data;
+    kstat_t ret = RHINO_SUCCESS;
 
-    // Push data
-    printf("Pushing data: ");
-    for (int i = 0; i < 5; i++) {
-        if (ringbuf_push(&ringbuf, &test_data[i], BLOCK_SIZE) == RHINO_SUCCESS) {
-            printf("%d ", test_data[i]);
-        } else {
-            printf("\nBuffer full at %d\n", i);
-            break;
+    if (vec == NULL || done == NULL) {
+        return RHINO_INV_PARAM;
+    }
+
+    if (p_ringbuf->type == RINGBUF_TYPE_FIX) {
+        for (size_t i = 0; i < cnt && ret == RHINO_SUCCESS; i++) {
+            if (vec[i].len % p_ringbuf->blk_size != 0) {
+                ret = RHINO_INV_PARAM;
+                break;
+            }
+
+            blks = vec[i].len / p_ringbuf->blk_size;
+            if (blks > (p_ringbuf->freesize - used) / p_ringbuf->blk_size) {
+                blks = (p_ringbuf->freesize - used) / p_ringbuf->blk_size;
+                ret = RHINO_RINGBUF_FULL;
+            }
+
+            pos = ringbuf_copy_in(p_ringbuf, pos, vec[i].base, blks * p_ringbuf->blk_size);
+            used += blks * p_ringbuf->blk_size;
+            num += blks;
+        }
+    } else {
+        // Capacity for the whole batch first, then copy without checks
+        for (len = 0; num < cnt; num++, used += len) {
+            if ((vec[num].len == 0u) || (vec[num].len >= (uint32_t)-1)) {
+                ret = RHINO_INV_PARAM;
+                break;
+            }
+
+            len = ringbuf_hdr_bytes(p_ringbuf, vec[num].len) + vec[num].len;
+            if (p_ringbuf->freesize - used < len) {
+                ret = RHINO_RINGBUF_FULL;
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < num; i++) {
+            len = ringbuf_hdr_encode(p_ringbuf, c_len, vec[i].len);
+            if ((p_ringbuf->flags & RINGBUF_FLAG_MIRROR) ||
+                (size_t)(p_ringbuf->end - pos) >= len + vec[i].len) {
+                // Whole record before end, the common case within a run
+                memcpy(pos, c_len, len);
+                memcpy(pos + len, vec[i].base, vec[i].len);
+                pos += len + vec[i].len;
+            } else {
+                pos = ringbuf_copy_in(p_ringbuf, pos, c_len, len);
+                pos = ringbuf_copy_in(p_ringbuf, pos, vec[i].base, vec[i].len);
+            }
         }
     }
-    printf("\n");
 
-    // Pop data
-    printf("Popping data: ");
-    while (ringbuf_pop(&ringbuf, &read_data, &len) == RHINO_SUCCESS) {
-        printf("%d ", read_data);
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        pos = ringbuf_mirror_fold(p_ringbuf, pos);
     }
-    printf("\n");
+
+    p_ringbuf->tail = pos;
+    p_ringbuf->freesize -= used;
+    *done = num;
+
+    return ret;
 }
 
-// Test function for dynamic-size ring buffer
-void test_dynamic_ringbuf(void)
+// Pop several records, *done is set to the number of records popped
+kstat_t ringbuf_pop_batch(k_ringbuf_t *p_ringbuf, k_ringbuf_vec_t *vec, size_t cnt, size_t *done)
 {
-    printf("\nTesting Dynamic-Size Ring Buffer:\n");
-    printf("----------------------------------\n");
+    uint8_t c_len[RING_BUF_LEN] = {0};
+    uint8_t *pos = p_ringbuf->head;
+    uint8_t *rec;
+    size_t avail = (p_ringbuf->end - p_ringbuf->buf) - p_ringbuf->freesize;
+    size_t used = 0;
+    size_t num = 0;
+    size_t len_bytes;
+    size_t blks;
+    size_t len;
+    kstat_t ret = RHINO_SUCCESS;
 
-    // Create buffer
-    const size_t BUF_SIZE = 100;
-    uint8_t buffer[BUF_SIZE];
-    k_ringbuf_t ringbuf;
+    if (vec == NULL || done == NULL) {
+        return RHINO_INV_PARAM;
+    }
 
-    // Initialize ring buffer
-    ringbuf_init(&ringbuf, buffer, BUF_SIZE, RINGBUF_TYPE_DYN, 0);
-    
-    // Test strings
-    const char *test_strings[] = {"Hello", "World", "Ring", "Buffer", "Test"};
-    size_t len;
-    char read_buffer[20];
+    if (avail == 0) {
+        *done = 0;
+        return RHINO_RINGBUF_FULL;
+    }
 
-    // Push strings
-    printf("Pushing strings: ");
-    for (int i = 0; i < 5; i++) {
-        size_t str_len = strlen(test_strings[i]) + 1;  // Include null terminator
-        if (ringbuf_push(&ringbuf, (void*)test_strings[i], str_len) == RHINO_SUCCESS) {
-            printf("%s ", test_strings[i]);
-        } else {
-            printf("\nBuffer full at %d\n", i);
-            break;
+    if (p_ringbuf->type == RINGBUF_TYPE_FIX) {
+        for (size_t i = 0; i < cnt && used < avail; i++) {
+            blks = vec[i].len / p_ringbuf->blk_size;
+            if (blks > (avail - used) / p_ringbuf->blk_size) {
+                blks = (avail - used) / p_ringbuf->blk_size;
+            }
+
+            pos = ringbuf_copy_out(p_ringbuf, pos, vec[i].base, blks * p_ringbuf->blk_size);
+            vec[i].len = blks * p_ringbuf->blk_size;
+            used += vec[i].len;
+            num += blks;
+        }
+    } else {
+        for (; num < cnt && used < avail; num++) {
+            rec = pos;
+            if (!(p_ringbuf->flags & RINGBUF_FLAG_MIRROR) && pos == p_ringbuf->end) {
+                pos = p_ringbuf->buf;
+            }
+
+            len_bytes = ringbuf_hdr_size(p_ringbuf, pos);
+            if ((p_ringbuf->flags & RINGBUF_FLAG_MIRROR) ||
+                (size_t)(p_ringbuf->end - pos) >= len_bytes) {
+                len = ringbuf_hdr_decode(p_ringbuf, pos);
+                pos += len_bytes;
+            } else {
+                pos = ringbuf_copy_out(p_ringbuf, pos, c_len, len_bytes);
+                len = ringbuf_hdr_decode(p_ringbuf, c_len);
+            }
+
+            if (len == 0 || len >= (uint32_t)-1 || len > vec[num].len) {
+                // Leave this record for the next call
+                pos = rec;
+                ret = RHINO_INV_PARAM;
+                break;
+            }
+
+            if ((p_ringbuf->flags & RINGBUF_FLAG_MIRROR) ||
+                (size_t)(p_ringbuf->end - pos) >= len) {
+                memcpy(vec[num].base, pos, len);
+                pos += len;
+            } else {
+                pos = ringbuf_copy_out(p_ringbuf, pos, vec[num].base, len);
+            }
+            vec[num].len = len;
+            used += len_bytes + len;
         }
     }
-    printf("\n");
 
-    // Pop strings
-    printf("Popping strings: ");
-    while (ringbuf_pop(&ringbuf, read_buffer, &len) == RHINO_SUCCESS) {
-        printf("%s ", read_buffer);
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        pos = ringbuf_mirror_fold(p_ringbuf, pos);
     }
-    printf("\n");
+
+    p_ringbuf->head = pos;
+    p_ringbuf->freesize += used;
+    *done = num;
+
+    return ret;
 }
 
-int main()
+// Zero-copy access for RINGBUF_TYPE_DYN.
+//
+// ringbuf_reserve/ringbuf_commit hand the producer a contiguous span to
+// fill in place, ringbuf_peek/ringbuf_release hand the consumer the same
+// span to read in place. Records never wrap: when the space left before
+// end is too short, the producer writes a skip marker there and starts
+// the record at buf. Records are padded to RING_BUF_LEN so payloads stay
+// aligned and a skip marker always fits; a gap too short for a header
+// (buffers whose length is not a multiple of RING_BUF_LEN) is skipped
+// implicitly. Because of the padding, a buffer driven by these calls must
+// not also be used with ringbuf_push/ringbuf_pop. On a mirrored buffer
+// every record is contiguous and no skip markers are written. Zero-copy
+// records always carry a RING_BUF_LEN header, RINGBUF_FLAG_VARINT only
+// applies to the copying paths.
+
+// Header value marking the rest of the buffer as padding
+#define RINGBUF_SKIP_MARK   ((size_t)-1)
+
+#define RINGBUF_ALIGN(len)  (((len) + RING_BUF_LEN - 1) & ~(RING_BUF_LEN - 1))
+
+// Reserve a contiguous span of len bytes for the next record
+kstat_t ringbuf_reserve(k_ringbuf_t *p_ringbuf, size_t len, void **pdata)
 {
-    // Test both fixed and dynamic ring buffers
-    test_fixed_ringbuf();
-    test_dynamic_ringbuf();
+    size_t need;
+    uint8_t *resv;
+
+    if (p_ringbuf->type != RINGBUF_TYPE_DYN || pdata == NULL) {
+        return RHINO_INV_PARAM;
+    }
+
+    if ((len == 0u) || (len >= (uint32_t)-1)) {
+        return RHINO_INV_PARAM;
+    }
+
+    need = RINGBUF_ALIGN(RING_BUF_LEN + len);
+    if (p_ringbuf->freesize < need) {
+        return RHINO_RINGBUF_FULL;
+    }
+
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        // Any record starting before end is contiguous
+        resv = p_ringbuf->tail;
+    } else if (ringbuf_is_empty(p_ringbuf)) {
+        // Nothing to preserve, commit restarts the buffer at buf
+        resv = p_ringbuf->buf;
+    } else if (p_ringbuf->tail < p_ringbuf->head) {
+        if ((size_t)(p_ringbuf->head - p_ringbuf->tail) < need) {
+            return RHINO_RINGBUF_FULL;
+        }
+        resv = p_ringbuf->tail;
+    } else if ((size_t)(p_ringbuf->end - p_ringbuf->tail) >= need) {
+        resv = p_ringbuf->tail;
+    } else if ((size_t)(p_ringbuf->head - p_ringbuf->buf) >= need) {
+        resv = p_ringbuf->buf;
+    } else {
+        return RHINO_RINGBUF_FULL;
+    }
+
+    p_ringbuf->resv = resv;
+    p_ringbuf->resv_len = len;
+    *pdata = resv + RING_BUF_LEN;
+
+    return RHINO_SUCCESS;
+}
+
+// Publish the reserved record, len may be shorter than reserved
+kstat_t ringbuf_commit(k_ringbuf_t *p_ringbuf, size_t len)
+{
+    size_t need;
+    size_t split_len;
+    size_t skip = RINGBUF_SKIP_MARK;
+
+    if (p_ringbuf->resv == NULL || len == 0u || len > p_ringbuf->resv_len) {
+        return RHINO_INV_PARAM;
+    }
+
+    if (p_ringbuf->resv != p_ringbuf->tail) {
+        if (ringbuf_is_empty(p_ringbuf)) {
+            p_ringbuf->head = p_ringbuf->buf;
+        } else {
+            // Pad out the tail of the buffer, the consumer skips to buf
+            split_len = p_ringbuf->end - p_ringbuf->tail;
+            if (split_len >= RING_BUF_LEN) {
+                memcpy(p_ringbuf->tail, &skip, RING_BUF_LEN);
+            }
+            p_ringbuf->freesize -= split_len;
+        }
+        p_ringbuf->tail = p_ringbuf->buf;
+    }
+
+    need = RINGBUF_ALIGN(RING_BUF_LEN + len);
+    memcpy(p_ringbuf->tail, &len, RING_BUF_LEN);
+    p_ringbuf->tail += need;
+    p_ringbuf->freesize -= need;
+    p_ringbuf->resv = NULL;
+
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        p_ringbuf->tail = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->tail);
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Get the oldest record in place without consuming it
+kstat_t ringbuf_peek(k_ringbuf_t *p_ringbuf, void **pdata, size_t *plen)
+{
+    size_t len = 0;
+
+    if (p_ringbuf->type != RINGBUF_TYPE_DYN || pdata == NULL || plen == NULL) {
+        return RHINO_INV_PARAM;
+    }
+
+    if (ringbuf_is_empty(p_ringbuf)) {
+        return RHINO_RINGBUF_FULL;
+    }
+
+    if ((p_ringbuf->flags & RINGBUF_FLAG_MIRROR) ||
+        (size_t)(p_ringbuf->end - p_ringbuf->head) >= RING_BUF_LEN) {
+        memcpy(&len, p_ringbuf->head, RING_BUF_LEN);
+    }
+
+    if (len == RINGBUF_SKIP_MARK ||
+        (!(p_ringbuf->flags & RINGBUF_FLAG_MIRROR) && (size_t)(p_ringbuf->end - p_ringbuf->head) < RING_BUF_LEN)) {
+        p_ringbuf->freesize += p_ringbuf->end - p_ringbuf->head;
+        p_ringbuf->head = p_ringbuf->buf;
+        memcpy(&len, p_ringbuf->head, RING_BUF_LEN);
+    }
+
+    if (len == 0 || len >= (uint32_t)-1) {
+        return RHINO_INV_PARAM;
+    }
+
+    *pdata = p_ringbuf->head + RING_BUF_LEN;
+    *plen = len;
+
+    return RHINO_SUCCESS;
+}
+
+// Consume the record returned by ringbuf_peek
+kstat_t ringbuf_release(k_ringbuf_t *p_ringbuf)
+{
+    void *pdata;
+    size_t len;
+    size_t need;
+    kstat_t ret;
+
+    ret = ringbuf_peek(p_ringbuf, &pdata, &len);
+    if (ret != RHINO_SUCCESS) {
+        return ret;
+    }
+
+    need = RINGBUF_ALIGN(RING_BUF_LEN + len);
+    p_ringbuf->head += need;
+    p_ringbuf->freesize += need;
+
+    if (p_ringbuf->flags & RINGBUF_FLAG_MIRROR) {
+        p_ringbuf->head = ringbuf_mirror_fold(p_ringbuf, p_ringbuf->head);
+    }
+
+    return RHINO_SUCCESS;
+}
+
+// Single-producer/single-consumer ring buffer.
+//
+// head and tail are free-running byte counters: only the consumer stores
+// head and only the producer stores tail, so no lock is needed. The store
+// of each counter is a release that publishes the bytes written (or freed)
+// before it, and is paired with an acquire load on the other side. Each
+// side keeps its own state on a separate cache line together with a cached
+// copy of the other side's counter, which is only reloaded when the cached
+// value says the buffer looks full (or empty).
+typedef struct {
+    uint8_t *buf;          // Start of buffer
+    size_t  len;           // Buffer length in bytes
+    size_t  type;          // Buffer type (FIX/DYN)
+    size_t  blk_size;      // Block size for fixed type
+
+    struct {
+        _Atomic size_t head;   // Bytes consumed so far
+        size_t  head_pos;      // head wrapped into [0, len)
+        size_t  tail_cache;    // Last tail seen by the consumer
+    } cons __attribute__((aligned(RINGBUF_CACHE_LINE)));
+
+    struct {
+        _Atomic size_t tail;   // Bytes produced so far
+        size_t  tail_pos;      // tail wrapped into [0, len)
+        size_t  head_cache;    // Last head seen by the producer
+    } prod __attribute__((aligned(RINGBUF_CACHE_LINE)));
+} k_ringbuf_spsc_t;
+
+// Initialize SPSC ring buffer
+kstat_t ringbuf_spsc_init(k_ringbuf_spsc_t *p_ringbuf, void *buf, size_t len, size_t type, size_t block_size)
+{
+    if (len == 0u || (type == RINGBUF_TYPE_FIX && (block_size == 0u || block_size > len))) {
+        return RHINO_INV_PARAM;
+    }
+
+    p_ringbuf->buf = buf;
+    p_ringbuf->len = len;
+    p_ringbuf->type = type;
+    p_ringbuf->blk_size = block_size;
+
+    atomic_init(&p_ringbuf->cons.head, 0);
+    p_ringbuf->cons.head_pos = 0;
+    p_ringbuf->cons.tail_cache = 0;
+
+    atomic_init(&p_ringbuf->prod.tail, 0);
+    p_ringbuf->prod.tail_pos = 0;
+    p_ringbuf->prod.head_cache = 0;
+
+    return RHINO_SUCCESS;
+}
+
+// Copy into the buffer at pos, wrapping at the end; returns the new pos
+static size_t ringbuf_spsc_copy_in(k_ringbuf_spsc_t *p_ringbuf, size_t pos, const void *data, size_t len)
+{
+    size_t split_len = p_ringbuf->len - pos;
+
+    if (len < split_len) {
+        memcpy(p_ringbuf->buf + pos, data, len);
+        return pos + len;
+    }
+
+    memcpy(p_ringbuf->buf + pos, data, split_len);
+    memcpy(p_ringbuf->buf, (const uint8_t *)data + split_len, len - split_len);
+    return len - split_len;
+}
+
+// Copy out of the buffer at pos, wrapping at the end; returns the new pos
+static size_t ringbuf_spsc_copy_out(k_ringbuf_spsc_t *p_ringbuf, size_t pos, void *pdata, size_t len)
+{
+    size_t split_len = p_ringbuf->len - pos;
+
+    if (len < split_len) {
+        memcpy(pdata, p_ringbuf->buf + pos, len);
+        return pos + len;
+    }
+
+    memcpy(pdata, p_ringbuf->buf + pos, split_len);
+    memcpy((uint8_t *)pdata + split_len, p_ringbuf->buf, len - split_len);
+    return len - split_len;
+}
+
+// Push data into SPSC ring buffer, producer side only
+kstat_t ringbuf_spsc_push(k_ringbuf_spsc_t *p_ringbuf, void *data, size_t len)
+{
+    size_t tail;
+    size_t need;
+    size_t pos;
+
+    if (p_ringbuf->type == RINGBUF_TYPE_FIX) {
+        len = p_ringbuf->blk_size;
+        need = len;
+    } else {
+        if ((len == 0u) || (len >= (uint32_t)-1)) {
+            return RHINO_INV_PARAM;
+        }
+        need = RING_BUF_LEN + len;
+    }
+
+    tail = atomic_load_explicit(&p_ringbuf->prod.tail, memory_order_relaxed);
+
+    if (p_ringbuf->len - (tail - p_ringbuf->prod.head_cache) < need) {
+        p_ringbuf->prod.head_cache = atomic_load_explicit(&p_ringbuf->cons.head, memory_order_acquire);
+        if (p_ringbuf->len - (tail - p_ringbuf->prod.head_cache) < need) {
+            return RHINO_RINGBUF_FULL;
+        }
+    }
+
+    pos = p_ringbuf->prod.tail_pos;
+    if (p_ringbuf->type != RINGBUF_TYPE_FIX) {
+        pos = ringbuf_spsc_copy_in(p_ringbuf, pos, &len, RING_BUF_LEN);
+    }
+    pos = ringbuf_spsc_copy_in(p_ringbuf, pos, data, len);
+
+    p_ringbuf->prod.tail_pos = pos;
+    atomic_store_explicit(&p_ringbuf->prod.tail, tail + need, memory_order_release);
+
+    return RHINO_SUCCESS;
+}
+
+// Pop data from SPSC ring buffer, consumer side only
+kstat_t ringbuf_spsc_pop(k_ringbuf_spsc_t *p_ringbuf, void *pdata, size_t *plen)
+{
+    size_t head;
+    size_t len;
+    size_t pos;
+
+    head = atomic_load_explicit(&p_ringbuf->cons.head, memory_order_relaxed);
+
+    if (p_ringbuf->cons.tail_cache == head) {
+        p_ringbuf->cons.tail_cache = atomic_load_explicit(&p_ringbuf->prod.tail, memory_order_acquire);
+        if (p_ringbuf->cons.tail_cache == head) {
+            return RHINO_RINGBUF_FULL;
+        }
+    }
+
+    pos = p_ringbuf->cons.head_pos;
+    if (p_ringbuf->type == RINGBUF_TYPE_FIX) {
+        len = p_ringbuf->blk_size;
+        pos = ringbuf_spsc_copy_out(p_ringbuf, pos, pdata, len);
+        head += len;
+    } else {
+        pos = ringbuf_spsc_copy_out(p_ringbuf, pos, &len, RING_BUF_LEN);
+        if (len == 0 || len >= (uint32_t)-1) {
+            return RHINO_INV_PARAM;
+        }
+        pos = ringbuf_spsc_copy_out(p_ringbuf, pos, pdata, len);
+        head += RING_BUF_LEN + len;
+    }
+
+    *plen = len;
+    p_ringbuf->cons.head_pos = pos;
+    atomic_store_explicit(&p_ringbuf->cons.head, head, memory_order_release);
+
+    return RHINO_SUCCESS;
+}
+
+// Check if SPSC ring buffer is empty
+uint8_t ringbuf_spsc_is_empty(k_ringbuf_spsc_t *p_ringbuf)
+{
+    return (atomic_load_explicit(&p_ringbuf->cons.head, memory_order_acquire) ==
+            atomic_load_explicit(&p_ringbuf->prod.tail, memory_order_acquire));
+}
+
+// Test function for fixed-size ring buffer
+void test_fixed_ringbuf(void)
+{
+    printf("\nTesting Fixed-Size Ring Buffer:\n");
+    printf("--------------------------------\n");
+
+    // Create buffer
+    const size_t BUF_SIZE = 20;
+    const size_t BLOCK_SIZE = 4;
+    uint8_t buffer[BUF_SIZE];
+    k_ringbuf_t ringbuf;
+
+    // Initialize ring buffer
+    ringbuf_init(&ringbuf, buffer, BUF_SIZE, RINGBUF_TYPE_FIX, BLOCK_SIZE);
+    
+    // Test data
+    int test_data[] = {1234, 5678, 9012, 3456, 7890};
+    size_t len;
+    int read_data;
+
+    // Push data
+    printf("Pushing data: ");
+    for (int i = 0; i < 5; i++) {
+        if (ringbuf_push(&ringbuf, &test_data[i], BLOCK_SIZE) == RHINO_SUCCESS) {
+            printf("%d ", test_data[i]);
+        } else {
+            printf("\nBuffer full at %d\n", i);
+            break;
+        }
+    }
+    printf("\n");
+
+    // Pop data
+    printf("Popping data: ");
+    while (ringbuf_pop(&ringbuf, &read_data, &len) == RHINO_SUCCESS) {
+        printf("%d ", read_data);
+    }
+    printf("\n");
+}
+
+// Test function for dynamic-size ring buffer
+void test_dynamic_ringbuf(void)
+{
+    printf("\nTesting Dynamic-Size Ring Buffer:\n");
+    printf("----------------------------------\n");
+
+    // Create buffer
+    const size_t BUF_SIZE = 100;
+    uint8_t buffer[BUF_SIZE];
+    k_ringbuf_t ringbuf;
+
+    // Initialize ring buffer
+    ringbuf_init(&ringbuf, buffer, BUF_SIZE, RINGBUF_TYPE_DYN, 0);
+    
+    // Test strings
+    const char *test_strings[] = {"Hello", "World", "Ring", "Buffer", "Test"};
+    size_t len;
+    char read_buffer[20];
+
+    // Push strings
+    printf("Pushing strings: ");
+    for (int i = 0; i < 5; i++) {
+        size_t str_len = strlen(test_strings[i]) + 1;  // Include null terminator
+        if (ringbuf_push(&ringbuf, (void*)test_strings[i], str_len) == RHINO_SUCCESS) {
+            printf("%s ", test_strings[i]);
+        } else {
+            printf("\nBuffer full at %d\n", i);
+            break;
+        }
+    }
+    printf("\n");
+
+    // Pop strings
+    printf("Popping strings: ");
+    while (ringbuf_pop(&ringbuf, read_buffer, &len) == RHINO_SUCCESS) {
+        printf("%s ", read_buffer);
+    }
+    printf("\n");
+}
+
+// Test function for SPSC ring buffer, both framings from one thread
+void test_spsc_ringbuf(void)
+{
+    printf("\nTesting SPSC Ring Buffer:\n");
+    printf("-------------------------\n");
+
+    uint8_t fix_buffer[20];
+    uint8_t dyn_buffer[40];
+    k_ringbuf_spsc_t ringbuf;
+    int test_data[] = {1234, 5678, 9012, 3456, 7890, 1111};
+    const char *test_strings[] = {"Hello", "World", "Ring", "Buffer", "Test"};
+    char read_buffer[20];
+    int read_data;
+    size_t len;
+
+    ringbuf_spsc_init(&ringbuf, fix_buffer, sizeof(fix_buffer), RINGBUF_TYPE_FIX, sizeof(int));
+
+    printf("Fixed push/pop: ");
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 6; i++) {
+            if (ringbuf_spsc_push(&ringbuf, &test_data[i], sizeof(int)) != RHINO_SUCCESS) {
+                break;
+            }
+        }
+        while (ringbuf_spsc_pop(&ringbuf, &read_data, &len) == RHINO_SUCCESS) {
+            printf("%d ", read_data);
+        }
+        printf("| ");
+    }
+    printf("\n");
+
+    // 40 bytes hold two framed strings, so headers and payloads wrap
+    ringbuf_spsc_init(&ringbuf, dyn_buffer, sizeof(dyn_buffer), RINGBUF_TYPE_DYN, 0);
+
+    printf("Dynamic push/pop: ");
+    for (int i = 0; i < 5; i++) {
+        size_t str_len = strlen(test_strings[i]) + 1;
+        if (ringbuf_spsc_push(&ringbuf, (void *)test_strings[i], str_len) != RHINO_SUCCESS) {
+            printf("\nBuffer full at %d\n", i);
+            break;
+        }
+        if (ringbuf_spsc_pop(&ringbuf, read_buffer, &len) == RHINO_SUCCESS) {
+            printf("%s ", read_buffer);
+        }
+    }
+    printf("\n");
+}
+
+// Test function for zero-copy reserve/commit and peek/release
+void test_zero_copy_ringbuf(void)
+{
+    printf("\nTesting Zero-Copy Ring Buffer:\n");
+    printf("------------------------------\n");
+
+    // 64 bytes hold two padded records, so later records skip to buf
+    uint8_t buffer[64];
+    k_ringbuf_t ringbuf;
+    const char *test_strings[] = {"Hello", "World", "Ring", "Buffer", "Test", "Zero", "Copy"};
+    void *span;
+    size_t len;
+
+    ringbuf_init(&ringbuf, buffer, sizeof(buffer), RINGBUF_TYPE_DYN, 0);
+
+    printf("Reserve/commit then peek/release: ");
+    for (int i = 0; i < 7; i++) {
+        size_t str_len = strlen(test_strings[i]) + 1;
+
+        // Reserve more than needed and commit the actual length
+        if (ringbuf_reserve(&ringbuf, 16, &span) != RHINO_SUCCESS) {
+            printf("\nBuffer full at %d\n", i);
+            break;
+        }
+        memcpy(span, test_strings[i], str_len);
+        ringbuf_commit(&ringbuf, str_len);
+
+        if (i % 2 == 0) {
+            continue;
+        }
+        while (ringbuf_peek(&ringbuf, &span, &len) == RHINO_SUCCESS) {
+            printf("%s(%zu) ", (char *)span, len);
+            ringbuf_release(&ringbuf);
+        }
+    }
+    while (ringbuf_peek(&ringbuf, &span, &len) == RHINO_SUCCESS) {
+        printf("%s(%zu) ", (char *)span, len);
+        ringbuf_release(&ringbuf);
+    }
+    printf("\n");
+}
+
+// Test function for mirrored ring buffer, records wrap across end
+void test_mirror_ringbuf(void)
+{
+    printf("\nTesting Mirrored Ring Buffer:\n");
+    printf("-----------------------------\n");
+
+    k_ringbuf_t ringbuf;
+    uint8_t msg[300];
+    uint8_t read_buffer[300];
+    size_t len;
+    size_t wrapped = 0;
+    int errors = 0;
+
+    if (ringbuf_init_mirror(&ringbuf, 1, RINGBUF_TYPE_DYN, 0) != RHINO_SUCCESS) {
+        printf("Failed to create ring buffer\n");
+        return;
+    }
+
+    printf("Backing: %s, %zu bytes\n",
+           (ringbuf.flags & RINGBUF_FLAG_MIRROR) ? "mirrored" : "fallback",
+           (size_t)(ringbuf.end - ringbuf.buf));
+
+    // Odd record sizes walk the wrap point across headers and payloads
+    for (int i = 0; i < 1000; i++) {
+        size_t msg_len = 1 + (i * 37) % sizeof(msg);
+        uint8_t *old_tail = ringbuf.tail;
+
+        memset(msg, i, msg_len);
+        if (ringbuf_push(&ringbuf, msg, msg_len) != RHINO_SUCCESS) {
+            errors++;
+            break;
+        }
+        wrapped += (ringbuf.tail < old_tail);
+
+        if (ringbuf_pop(&ringbuf, read_buffer, &len) != RHINO_SUCCESS ||
+            len != msg_len || memcmp(read_buffer, msg, len) != 0) {
+            errors++;
+        }
+    }
+    printf("Dynamic records: 1000 pushed and popped, %zu wrapped, %d errors\n", wrapped, errors);
+
+    // Zero-copy records are handed out in one span even across end
+    errors = 0;
+    wrapped = 0;
+    for (int i = 0; i < 1000; i++) {
+        size_t msg_len = 1 + (i * 37) % sizeof(msg);
+        uint8_t *old_tail = ringbuf.tail;
+        void *span;
+
+        memset(msg, i, msg_len);
+        if (ringbuf_reserve(&ringbuf, msg_len, &span) != RHINO_SUCCESS) {
+            errors++;
+            break;
+        }
+        memcpy(span, msg, msg_len);
+        ringbuf_commit(&ringbuf, msg_len);
+        wrapped += (ringbuf.tail < old_tail);
+
+        if (ringbuf_peek(&ringbuf, &span, &len) != RHINO_SUCCESS ||
+            len != msg_len || memcmp(span, msg, len) != 0) {
+            errors++;
+        }
+        ringbuf_release(&ringbuf);
+    }
+    printf("Zero-copy records: 1000 reserved and peeked, %zu wrapped, %d errors\n", wrapped, errors);
+
+    ringbuf_deinit(&ringbuf);
+
+    // Fallback backing for a FIX buffer whose page-rounded length is not a
+    // whole number of 24-byte blocks
+    errors = 0;
+    wrapped = 0;
+    if (ringbuf_init_alloc(&ringbuf, 4096, RINGBUF_TYPE_FIX, 24) != RHINO_SUCCESS) {
+        printf("Failed to create ring buffer\n");
+        return;
+    }
+    for (int i = 0; i < 1000; i++) {
+        uint8_t *old_tail = ringbuf.tail;
+
+        memset(msg, i, 24);
+        if (ringbuf_push(&ringbuf, msg, 24) != RHINO_SUCCESS) {
+            errors++;
+            break;
+        }
+        wrapped += (ringbuf.tail < old_tail);
+
+        if (ringbuf_pop(&ringbuf, read_buffer, &len) != RHINO_SUCCESS ||
+            memcmp(read_buffer, msg, 24) != 0) {
+            errors++;
+        }
+    }
+    printf("Fallback fixed blocks: %zu bytes, 1000 pushed and popped, %zu wrapped, %d errors\n",
+           (size_t)(ringbuf.end - ringbuf.buf), wrapped, errors);
+    ringbuf_deinit(&ringbuf);
+
+    printf("Fallback block larger than the buffer: %s\n",
+           ringbuf_init_alloc(&ringbuf, 16, RINGBUF_TYPE_FIX, 24) == RHINO_INV_PARAM ? "rejected" : "accepted");
+}
+
+// Push/pop records of many lengths, keeping a few queued so both header
+// and payload keep splitting at end; returns the number of mismatches
+static int test_varint_round(k_ringbuf_t *p_ringbuf, size_t max_len)
+{
+    uint8_t msg[300];
+    uint8_t read_buffer[300];
+    size_t next_pop = 0;
+    size_t len;
+    int errors = 0;
+
+    for (size_t i = 0; i < 2000; i++) {
+        size_t msg_len = 1 + (i * 53) % max_len;
+
+        memset(msg, (int)i, msg_len);
+        while (ringbuf_push(p_ringbuf, msg, msg_len) != RHINO_SUCCESS) {
+            size_t pop_len = 1 + (next_pop * 53) % max_len;
+
+            if (ringbuf_pop(p_ringbuf, read_buffer, &len) != RHINO_SUCCESS ||
+                len != pop_len || read_buffer[len - 1] != (uint8_t)next_pop) {
+                errors++;
+            }
+            next_pop++;
+        }
+    }
+    while (ringbuf_pop(p_ringbuf, read_buffer, &len) == RHINO_SUCCESS) {
+        if (len != 1 + (next_pop * 53) % max_len || read_buffer[len - 1] != (uint8_t)next_pop) {
+            errors++;
+        }
+        next_pop++;
+    }
+
+    return errors + (next_pop != 2000);
+}
+
+// Test function for LEB128 length headers, plain and mirrored backing
+void test_varint_ringbuf(void)
+{
+    printf("\nTesting Varint Length Headers:\n");
+    printf("------------------------------\n");
+
+    uint8_t buffer[701];
+    k_ringbuf_t ringbuf;
+
+    // Records up to 300 bytes need 1- and 2-byte headers
+    ringbuf_init(&ringbuf, buffer, sizeof(buffer), RINGBUF_TYPE_DYN, 0);
+    ringbuf_set_varint(&ringbuf);
+    printf("Plain backing: %d errors\n", test_varint_round(&ringbuf, 300));
+
+    if (ringbuf_init_mirror(&ringbuf, 1, RINGBUF_TYPE_DYN, 0) == RHINO_SUCCESS) {
+        ringbuf_set_varint(&ringbuf);
+        printf("Mirrored backing: %d errors\n", test_varint_round(&ringbuf, 300));
+        ringbuf_deinit(&ringbuf);
+    }
+}
+
+// Push and pop batches on one ring, checking every record; returns mismatches
+static int test_batch_round(k_ringbuf_t *p_ringbuf)
+{
+    uint8_t msgs[8][64];
+    uint8_t reads[8][64];
+    k_ringbuf_vec_t vec[8];
+    size_t next_push = 0, next_pop = 0;
+    size_t done;
+    int errors = 0;
+
+    for (int round = 0; round < 200; round++) {
+        size_t cnt = 1 + round % 8;
+
+        for (size_t i = 0; i < cnt; i++) {
+            size_t msg_len = 1 + ((next_push + i) * 29) % 64;
+
+            memset(msgs[i], (int)(next_push + i), msg_len);
+            vec[i].base = msgs[i];
+            vec[i].len = msg_len;
+        }
+        ringbuf_push_batch(p_ringbuf, vec, cnt, &done);
+        next_push += done;
+
+        for (size_t i = 0; i < 8; i++) {
+            vec[i].base = reads[i];
+            vec[i].len = sizeof(reads[i]);
+        }
+        ringbuf_pop_batch(p_ringbuf, vec, 1 + (round * 3) % 8, &done);
+        for (size_t i = 0; i < done; i++, next_pop++) {
+            if (vec[i].len != 1 + (next_pop * 29) % 64 || reads[i][vec[i].len - 1] != (uint8_t)next_pop) {
+                errors++;
+            }
+        }
+    }
+
+    return errors;
+}
+
+// Test function for batched push/pop
+void test_batch_ringbuf(void)
+{
+    printf("\nTesting Batched Ring Buffer:\n");
+    printf("----------------------------\n");
+
+    uint8_t buffer[301];
+    k_ringbuf_t ringbuf;
+    int blocks[7] = {1, 2, 3, 4, 5, 6, 7};
+    int read_blocks[7] = {0};
+    k_ringbuf_vec_t vec;
+    size_t done;
+
+    // 24-byte buffer of 4-byte blocks: two batches land across end
+    ringbuf_init(&ringbuf, buffer, 24, RINGBUF_TYPE_FIX, sizeof(int));
+    printf("Fixed batches: ");
+    for (int round = 0; round < 3; round++) {
+        vec.base = blocks;
+        vec.len = sizeof(blocks);
+        ringbuf_push_batch(&ringbuf, &vec, 1, &done);
+        printf("pushed %zu ", done);
+
+        vec.base = read_blocks;
+        vec.len = 4 * sizeof(int);
+        ringbuf_pop_batch(&ringbuf, &vec, 1, &done);
+        printf("popped %zu [", done);
+        for (size_t i = 0; i < done; i++) {
+            printf("%s%d", i ? " " : "", read_blocks[i]);
+        }
+        printf("] ");
+    }
+    printf("\n");
+
+    ringbuf_init(&ringbuf, buffer, sizeof(buffer), RINGBUF_TYPE_DYN, 0);
+    printf("Dynamic batches: %d errors\n", test_batch_round(&ringbuf));
+
+    ringbuf_init(&ringbuf, buffer, sizeof(buffer), RINGBUF_TYPE_DYN, 0);
+    ringbuf_set_varint(&ringbuf);
+    printf("Dynamic batches, varint headers: %d errors\n", test_batch_round(&ringbuf));
+
+    if (ringbuf_init_mirror(&ringbuf, 1, RINGBUF_TYPE_DYN, 0) == RHINO_SUCCESS) {
+        printf("Dynamic batches, mirrored: %d errors\n", test_batch_round(&ringbuf));
+        ringbuf_deinit(&ringbuf);
+    }
+}
+
+#define BENCH_RING_SIZE    (64 * 1024)
+#define BENCH_MSG_COUNT    2000000
+#define BENCH_MSG_SIZE     32
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef struct {
+    k_ringbuf_t     ringbuf;
+    pthread_mutex_t mutex;
+} bench_locked_ringbuf_t;
+
+typedef struct {
+    void   *ring;
+    size_t  type;
+    size_t  msg_size;
+    size_t  errors;
+} bench_spsc_arg_t;
+
+static kstat_t bench_locked_push(bench_locked_ringbuf_t *p_locked, void *data, size_t len)
+{
+    kstat_t ret;
+
+    pthread_mutex_lock(&p_locked->mutex);
+    ret = ringbuf_push(&p_locked->ringbuf, data, len);
+    pthread_mutex_unlock(&p_locked->mutex);
+    return ret;
+}
+
+static kstat_t bench_locked_pop(bench_locked_ringbuf_t *p_locked, void *pdata, size_t *plen)
+{
+    kstat_t ret;
+
+    pthread_mutex_lock(&p_locked->mutex);
+    ret = ringbuf_pop(&p_locked->ringbuf, pdata, plen);
+    pthread_mutex_unlock(&p_locked->mutex);
+    return ret;
+}
+
+static void *bench_locked_producer(void *arg)
+{
+    bench_spsc_arg_t *p_arg = arg;
+    uint8_t msg[BENCH_MSG_SIZE] = {0};
+
+    for (uint32_t seq = 0; seq < BENCH_MSG_COUNT; seq++) {
+        memcpy(msg, &seq, sizeof(seq));
+        while (bench_locked_push(p_arg->ring, msg, p_arg->msg_size) != RHINO_SUCCESS) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *bench_locked_consumer(void *arg)
+{
+    bench_spsc_arg_t *p_arg = arg;
+    uint8_t msg[BENCH_MSG_SIZE];
+    uint32_t seq;
+    size_t len;
+
+    for (uint32_t expect = 0; expect < BENCH_MSG_COUNT; expect++) {
+        while (bench_locked_pop(p_arg->ring, msg, &len) != RHINO_SUCCESS) {
+            sched_yield();
+        }
+        memcpy(&seq, msg, sizeof(seq));
+        if (seq != expect || len != p_arg->msg_size) {
+            p_arg->errors++;
+        }
+    }
+    return NULL;
+}
+
+static void *bench_spsc_producer(void *arg)
+{
+    bench_spsc_arg_t *p_arg = arg;
+    uint8_t msg[BENCH_MSG_SIZE] = {0};
+
+    for (uint32_t seq = 0; seq < BENCH_MSG_COUNT; seq++) {
+        memcpy(msg, &seq, sizeof(seq));
+        while (ringbuf_spsc_push(p_arg->ring, msg, p_arg->msg_size) != RHINO_SUCCESS) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *bench_spsc_consumer(void *arg)
+{
+    bench_spsc_arg_t *p_arg = arg;
+    uint8_t msg[BENCH_MSG_SIZE];
+    uint32_t seq;
+    size_t len;
+
+    for (uint32_t expect = 0; expect < BENCH_MSG_COUNT; expect++) {
+        while (ringbuf_spsc_pop(p_arg->ring, msg, &len) != RHINO_SUCCESS) {
+            sched_yield();
+        }
+        memcpy(&seq, msg, sizeof(seq));
+        if (seq != expect || len != p_arg->msg_size) {
+            p_arg->errors++;
+        }
+    }
+    return NULL;
+}
+
+static void bench_spsc_run(const char *label, void *ring, size_t type, size_t msg_size,
+                           void *(*producer)(void *), void *(*consumer)(void *))
+{
+    bench_spsc_arg_t prod_arg = {ring, type, msg_size, 0};
+    bench_spsc_arg_t cons_arg = {ring, type, msg_size, 0};
+    pthread_t prod, cons;
+    uint64_t start, elapsed;
+
+    start = bench_now_ns();
+    pthread_create(&cons, NULL, consumer, &cons_arg);
+    pthread_create(&prod, NULL, producer, &prod_arg);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    elapsed = bench_now_ns() - start;
+
+    printf("%-22s %8.2f Mmsg/s %8.1f ns/msg  errors=%zu\n", label,
+           BENCH_MSG_COUNT * 1000.0 / elapsed, (double)elapsed / BENCH_MSG_COUNT, cons_arg.errors);
+}
+
+// Two-thread throughput: mutex-wrapped k_ringbuf_t vs k_ringbuf_spsc_t
+void bench_spsc_ringbuf(void)
+{
+    static uint8_t buffer[BENCH_RING_SIZE];
+    static bench_locked_ringbuf_t locked;
+    static k_ringbuf_spsc_t spsc;
+
+    printf("\nBenchmark: SPSC vs mutex-wrapped ring buffer (%d msgs)\n", BENCH_MSG_COUNT);
+    printf("--------------------------------------------------------\n");
+
+    pthread_mutex_init(&locked.mutex, NULL);
+
+    ringbuf_init(&locked.ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_FIX, BENCH_MSG_SIZE);
+    bench_spsc_run("mutex FIX", &locked, RINGBUF_TYPE_FIX, BENCH_MSG_SIZE,
+                   bench_locked_producer, bench_locked_consumer);
+    ringbuf_spsc_init(&spsc, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_FIX, BENCH_MSG_SIZE);
+    bench_spsc_run("spsc FIX", &spsc, RINGBUF_TYPE_FIX, BENCH_MSG_SIZE,
+                   bench_spsc_producer, bench_spsc_consumer);
+
+    ringbuf_init(&locked.ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+    bench_spsc_run("mutex DYN", &locked, RINGBUF_TYPE_DYN, BENCH_MSG_SIZE - 4,
+                   bench_locked_producer, bench_locked_consumer);
+    ringbuf_spsc_init(&spsc, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+    bench_spsc_run("spsc DYN", &spsc, RINGBUF_TYPE_DYN, BENCH_MSG_SIZE - 4,
+                   bench_spsc_producer, bench_spsc_consumer);
+
+    pthread_mutex_destroy(&locked.mutex);
+}
+
+#define BENCH_LOG_COUNT    200000
+#define BENCH_LOG_SIZE     2048
+
+static void bench_fill_record(uint8_t *rec, uint32_t seq)
+{
+    memset(rec, (uint8_t)seq, BENCH_LOG_SIZE);
+    memcpy(rec, &seq, sizeof(seq));
+}
+
+static uint32_t bench_check_record(const uint8_t *rec, size_t len)
+{
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < len; i += 64) {
+        sum += rec[i];
+    }
+    return sum;
+}
+
+// Single thread, multi-KB records: ringbuf_push/pop vs reserve/commit + peek/release
+void bench_zero_copy_ringbuf(void)
+{
+    static uint8_t buffer[BENCH_RING_SIZE];
+    static uint8_t record[BENCH_LOG_SIZE];
+    k_ringbuf_t ringbuf;
+    uint32_t produced, consumed;
+    uint32_t sum_copy = 0, sum_zc = 0;
+    uint64_t start, copy_ns, zc_ns;
+    void *span;
+    size_t len;
+
+    printf("\nBenchmark: copy vs zero-copy, %d byte records (%d msgs)\n", BENCH_LOG_SIZE, BENCH_LOG_COUNT);
+    printf("---------------------------------------------------------\n");
+
+    ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+    start = bench_now_ns();
+    for (produced = 0, consumed = 0; consumed < BENCH_LOG_COUNT; ) {
+        while (produced < BENCH_LOG_COUNT) {
+            bench_fill_record(record, produced);
+            if (ringbuf_push(&ringbuf, record, BENCH_LOG_SIZE) != RHINO_SUCCESS) {
+                break;
+            }
+            produced++;
+        }
+        while (ringbuf_pop(&ringbuf, record, &len) == RHINO_SUCCESS) {
+            sum_copy += bench_check_record(record, len);
+            consumed++;
+        }
+    }
+    copy_ns = bench_now_ns() - start;
+
+    ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+    start = bench_now_ns();
+    for (produced = 0, consumed = 0; consumed < BENCH_LOG_COUNT; ) {
+        while (produced < BENCH_LOG_COUNT) {
+            if (ringbuf_reserve(&ringbuf, BENCH_LOG_SIZE, &span) != RHINO_SUCCESS) {
+                break;
+            }
+            bench_fill_record(span, produced);
+            ringbuf_commit(&ringbuf, BENCH_LOG_SIZE);
+            produced++;
+        }
+        while (ringbuf_peek(&ringbuf, &span, &len) == RHINO_SUCCESS) {
+            sum_zc += bench_check_record(span, len);
+            ringbuf_release(&ringbuf);
+            consumed++;
+        }
+    }
+    zc_ns = bench_now_ns() - start;
+
+    // Not measured: what each path's memcpy calls move per message by
+    // construction, header and payload in and out vs the header alone
+    printf("%-22s %8.1f ns/msg %6zu bytes copied/msg (theoretical)\n", "push/pop",
+           (double)copy_ns / BENCH_LOG_COUNT, 2 * (RING_BUF_LEN + BENCH_LOG_SIZE));
+    printf("%-22s %8.1f ns/msg %6zu bytes copied/msg (theoretical)\n", "reserve/peek",
+           (double)zc_ns / BENCH_LOG_COUNT, 2 * RING_BUF_LEN);
+    printf("checksums %s\n", sum_copy == sum_zc ? "match" : "MISMATCH");
+}
+
+#define BENCH_WRAP_COUNT   5000000
+#define BENCH_WRAP_SIZE    100
+
+static uint64_t bench_push_pop(k_ringbuf_t *p_ringbuf, int count)
+{
+    uint8_t msg[BENCH_WRAP_SIZE] = {0};
+    uint8_t read_buffer[BENCH_WRAP_SIZE];
+    uint64_t start;
+    size_t len;
+
+    start = bench_now_ns();
+    for (int popped = 0; popped < count; ) {
+        // Refill, then drain to half full so the wrap point keeps moving
+        while (ringbuf_push(p_ringbuf, msg, BENCH_WRAP_SIZE) == RHINO_SUCCESS) {
+        }
+        while (p_ringbuf->freesize < (size_t)(p_ringbuf->end - p_ringbuf->buf) / 2) {
+            ringbuf_pop(p_ringbuf, read_buffer, &len);
+            popped++;
+        }
+    }
+    return bench_now_ns() - start;
+}
+
+// Single thread, records straddling end: split-copy path vs mirrored mapping
+void bench_mirror_ringbuf(void)
+{
+    k_ringbuf_t mirror;
+    k_ringbuf_t plain;
+    uint64_t plain_ns, mirror_ns;
+
+    printf("\nBenchmark: split-copy vs mirrored ring buffer (%d msgs)\n", BENCH_WRAP_COUNT);
+    printf("--------------------------------------------------------\n");
+
+    if (ringbuf_init_mirror(&mirror, 4096, RINGBUF_TYPE_DYN, 0) != RHINO_SUCCESS) {
+        printf("Failed to create ring buffer, skipped\n");
+        return;
+    }
+    if (!(mirror.flags & RINGBUF_FLAG_MIRROR)) {
+        printf("mirrored mapping unavailable, skipped\n");
+        ringbuf_deinit(&mirror);
+        return;
+    }
+    if (ringbuf_init_alloc(&plain, 4096, RINGBUF_TYPE_DYN, 0) != RHINO_SUCCESS) {
+        printf("Failed to create ring buffer, skipped\n");
+        ringbuf_deinit(&mirror);
+        return;
+    }
+
+    plain_ns = bench_push_pop(&plain, BENCH_WRAP_COUNT);
+    mirror_ns = bench_push_pop(&mirror, BENCH_WRAP_COUNT);
+
+    printf("%-22s %8.1f ns/msg\n", "split-copy", (double)plain_ns / BENCH_WRAP_COUNT);
+    printf("%-22s %8.1f ns/msg\n", "mirrored", (double)mirror_ns / BENCH_WRAP_COUNT);
+
+    ringbuf_deinit(&plain);
+    ringbuf_deinit(&mirror);
+}
+
+// Messages held before RHINO_RINGBUF_FULL with RING_BUF_LEN vs varint headers
+void bench_varint_ringbuf(void)
+{
+    static uint8_t buffer[BENCH_RING_SIZE];
+    static const size_t msg_sizes[] = {16, 32, 64, 256};
+    uint8_t msg[256] = {0};
+    k_ringbuf_t ringbuf;
+
+    printf("\nBenchmark: effective capacity of a %d byte ring\n", BENCH_RING_SIZE);
+    printf("-----------------------------------------------\n");
+    printf("%-10s %12s %12s %8s\n", "msg size", "fixed hdr", "varint hdr", "gain");
+
+    for (size_t i = 0; i < sizeof(msg_sizes) / sizeof(msg_sizes[0]); i++) {
+        size_t fixed_cnt = 0, varint_cnt = 0;
+
+        ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+        while (ringbuf_push(&ringbuf, msg, msg_sizes[i]) == RHINO_SUCCESS) {
+            fixed_cnt++;
+        }
+
+        ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, RINGBUF_TYPE_DYN, 0);
+        ringbuf_set_varint(&ringbuf);
+        while (ringbuf_push(&ringbuf, msg, msg_sizes[i]) == RHINO_SUCCESS) {
+            varint_cnt++;
+        }
+
+        printf("%-10zu %12zu %12zu %7.1f%%\n", msg_sizes[i], fixed_cnt, varint_cnt,
+               100.0 * (varint_cnt - fixed_cnt) / fixed_cnt);
+    }
+}
+
+#define BENCH_TICK_RECORDS 1000
+#define BENCH_TICK_COUNT   2000
+#define BENCH_SMALL_SIZE   16
+
+// Thousands of small records per tick: single calls vs batches
+void bench_batch_ringbuf(void)
+{
+    static uint8_t buffer[BENCH_RING_SIZE];
+    static uint8_t msgs[BENCH_TICK_RECORDS][BENCH_SMALL_SIZE];
+    static uint8_t reads[BENCH_TICK_RECORDS][BENCH_SMALL_SIZE];
+    static k_ringbuf_vec_t vec[BENCH_TICK_RECORDS];
+    k_ringbuf_t ringbuf;
+    uint64_t start, single_ns, batch_ns;
+    size_t done;
+    size_t len;
+
+    printf("\nBenchmark: single vs batched push/pop, %d x %d byte records per tick\n",
+           BENCH_TICK_RECORDS, BENCH_SMALL_SIZE);
+    printf("---------------------------------------------------------------------\n");
+
+    for (size_t type = RINGBUF_TYPE_DYN; type <= RINGBUF_TYPE_FIX; type++) {
+        ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, type, BENCH_SMALL_SIZE);
+        start = bench_now_ns();
+        for (int tick = 0; tick < BENCH_TICK_COUNT; tick++) {
+            for (int i = 0; i < BENCH_TICK_RECORDS; i++) {
+                ringbuf_push(&ringbuf, msgs[i], BENCH_SMALL_SIZE);
+            }
+            for (int i = 0; i < BENCH_TICK_RECORDS; i++) {
+                ringbuf_pop(&ringbuf, reads[i], &len);
+            }
+        }
+        single_ns = bench_now_ns() - start;
+
+        ringbuf_init(&ringbuf, buffer, BENCH_RING_SIZE, type, BENCH_SMALL_SIZE);
+        start = bench_now_ns();
+        for (int tick = 0; tick < BENCH_TICK_COUNT; tick++) {
+            if (type == RINGBUF_TYPE_FIX) {
+                // Blocks are contiguous, one vector carries the whole tick
+                vec[0].base = msgs;
+                vec[0].len = sizeof(msgs);
+                ringbuf_push_batch(&ringbuf, vec, 1, &done);
+                vec[0].base = reads;
+                vec[0].len = sizeof(reads);
+                ringbuf_pop_batch(&ringbuf, vec, 1, &done);
+            } else {
+                for (int i = 0; i < BENCH_TICK_RECORDS; i++) {
+                    vec[i].base = msgs[i];
+                    vec[i].len = BENCH_SMALL_SIZE;
+                }
+                ringbuf_push_batch(&ringbuf, vec, BENCH_TICK_RECORDS, &done);
+                for (int i = 0; i < BENCH_TICK_RECORDS; i++) {
+                    vec[i].base = reads[i];
+                    vec[i].len = BENCH_SMALL_SIZE;
+                }
+                ringbuf_pop_batch(&ringbuf, vec, BENCH_TICK_RECORDS, &done);
+            }
+        }
+        batch_ns = bench_now_ns() - start;
+
+        printf("%s single %8.2f ns/record   batch %8.2f ns/record\n",
+               type == RINGBUF_TYPE_FIX ? "FIX" : "DYN",
+               (double)single_ns / ((double)BENCH_TICK_COUNT * BENCH_TICK_RECORDS),
+               (double)batch_ns / ((double)BENCH_TICK_COUNT * BENCH_TICK_RECORDS));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Test both fixed and dynamic ring buffers
+    test_fixed_ringbuf();
+    test_dynamic_ringbuf();
+    test_spsc_ringbuf();
+    test_zero_copy_ringbuf();
+    test_mirror_ringbuf();
+    test_varint_ringbuf();
+    test_batch_ringbuf();
+
+    // Benchmarks only run on request: ./ringbuf_test bench
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench_spsc_ringbuf();
+        bench_zero_copy_ringbuf();
+        bench_mirror_ringbuf();
+        bench_varint_ringbuf();
+        bench_batch_ringbuf();
+    }
     
     return 0;
 }